@@ -9,10 +9,35 @@ using i64 = glm::i64;
 using lmat3 = mat<3, 3, int64_t, glm::highp>;
 using lvec3 = vec<3, int64_t>;
 using u16vec2 = glm::u16vec2;
+using glm::u8;
 using glm::u16;
 using glm::u32;
+using glm::u64;
 using glm::u8vec4;
 
+// Non-owning view over a contiguous range, used to hand sub-ranges of the scene buffers to the rasterizer
+template <typename T>
+struct Span {
+	Span() = default;
+	Span(T* data, size_t size) : m_data(data), m_size(size) {}
+
+	template <typename Container>
+	Span(Container& container) : m_data(container.data()), m_size(container.size()) {}
+
+	T* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	T* begin() const { return m_data; }
+	T* end() const { return m_data + m_size; }
+	T& operator[](size_t idx) const { return m_data[idx]; }
+
+	Span subspan(size_t offset, size_t count) const { return {m_data + offset, count}; }
+
+private:
+	T* m_data = nullptr;
+	size_t m_size = 0;
+};
+
 template <typename T>
 struct DetermineDimension;
 
@@ -0,0 +1,115 @@
+#include "benchmark.h"
+
+#include <stdexcept>
+
+namespace {
+
+double toMs(std::chrono::nanoseconds time) {
+	return std::chrono::duration<double, std::milli>(time).count();
+}
+
+void writePipelineStats(std::ostream& out, const PipelineStats& stats, const char* indent) {
+	out << indent << "\"ticks\": {";
+	for (size_t i = 0; i < PIPELINE_STAGE_COUNT; ++i) {
+		out << (i ? ", " : "") << "\"" << pipelineStageName(PipelineStage(i)) << "\": " << stats.ticks[i];
+	}
+	out << "},\n" << indent << "\"counters\": {";
+	for (size_t i = 0; i < PIPELINE_COUNTER_COUNT; ++i) {
+		out << (i ? ", " : "") << "\"" << pipelineCounterName(PipelineCounter(i)) << "\": " << stats.counts[i];
+	}
+	out << "}";
+}
+
+// Nearest rank percentile of sorted values
+double percentile(const std::vector<double>& sorted, double p) {
+	auto rank = size_t(std::ceil(p / 100 * sorted.size()));
+	return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+}
+
+BenchmarkReport summarizeBenchmark(const uvec2& viewport, size_t warmupFrames, const std::vector<FrameSample>& samples) {
+	if (samples.empty()) {
+		std::cerr << "Benchmark without measured frames" << std::endl;
+		throw std::runtime_error("no benchmark frames");
+	}
+
+	BenchmarkReport ret;
+	std::vector<double> times;
+	std::chrono::nanoseconds total(0);
+	u64 triangles = 0;
+	u64 textureSwitches = 0;
+	u64 sceneOrderTextureSwitches = 0;
+	for (const auto& sample : samples) {
+		times.push_back(toMs(sample.time));
+		total += sample.time;
+		triangles += sample.triangles;
+		textureSwitches += sample.textureSwitches;
+		sceneOrderTextureSwitches += sample.sceneOrderTextureSwitches;
+		ret.pipeline += sample.pipeline;
+	}
+	std::sort(times.begin(), times.end());
+	auto seconds = std::chrono::duration<double>(total).count();
+
+	ret.viewport = viewport;
+	ret.warmupFrames = warmupFrames;
+	ret.frames = samples.size();
+	ret.minMs = times.front();
+	ret.medianMs = percentile(times, 50);
+	ret.p95Ms = percentile(times, 95);
+	ret.p99Ms = percentile(times, 99);
+	ret.maxMs = times.back();
+	ret.meanMs = toMs(total) / samples.size();
+	ret.trianglesPerSecond = triangles / seconds;
+	ret.pixelsPerSecond = double(viewport.x) * viewport.y * samples.size() / seconds;
+	ret.textureSwitches = double(textureSwitches) / samples.size();
+	ret.sceneOrderTextureSwitches = double(sceneOrderTextureSwitches) / samples.size();
+	return ret;
+}
+
+void writeBenchmarkJson(std::ostream& out, const BenchmarkReport& report) {
+	out << std::fixed << std::setprecision(3)
+		<< "{\n"
+		<< "\t\"viewport\": [" << report.viewport.x << ", " << report.viewport.y << "],\n"
+		<< "\t\"warmupFrames\": " << report.warmupFrames << ",\n"
+		<< "\t\"frames\": " << report.frames << ",\n"
+		<< "\t\"frameTimeMs\": {\n"
+		<< "\t\t\"min\": " << report.minMs << ",\n"
+		<< "\t\t\"median\": " << report.medianMs << ",\n"
+		<< "\t\t\"p95\": " << report.p95Ms << ",\n"
+		<< "\t\t\"p99\": " << report.p99Ms << ",\n"
+		<< "\t\t\"max\": " << report.maxMs << ",\n"
+		<< "\t\t\"mean\": " << report.meanMs << "\n"
+		<< "\t},\n"
+		<< "\t\"trianglesPerSecond\": " << std::setprecision(0) << report.trianglesPerSecond << ",\n"
+		<< "\t\"pixelsPerSecond\": " << report.pixelsPerSecond << ",\n"
+		<< std::setprecision(3)
+		<< "\t\"textureSwitchesPerFrame\": {\"submitted\": " << report.textureSwitches
+		<< ", \"sceneOrder\": " << report.sceneOrderTextureSwitches << "},\n"
+		<< "\t\"workers\": [";
+	for (size_t i = 0; i < report.workers.size(); ++i) {
+		const auto& worker = report.workers[i];
+		out << (i ? ",\n" : "\n") << "\t\t{\"jobs\": " << worker.jobs << ", \"steals\": " << worker.steals
+			<< ", \"busyMs\": " << toMs(worker.busy) << ", \"utilization\": " << worker.utilization() << "}";
+	}
+	out << "\n\t]";
+
+	if constexpr (PIPELINE_STATS) {
+		out << ",\n\t\"pipeline\": {\n";
+		writePipelineStats(out, report.pipeline, "\t\t");
+		out << ",\n\t\t\"meshes\": [";
+		auto first = true;
+		for (size_t mesh = 0; mesh < report.meshPipeline.size(); ++mesh) {
+			const auto& stats = report.meshPipeline[mesh];
+			if (stats[PipelineCounter::TrianglesIn] == 0) {
+				continue;
+			}
+			out << (first ? "\n" : ",\n") << "\t\t\t{\n\t\t\t\t\"mesh\": " << mesh << ",\n";
+			writePipelineStats(out, stats, "\t\t\t\t");
+			out << "\n\t\t\t}";
+			first = false;
+		}
+		out << "\n\t\t]\n\t}";
+	}
+	out << "\n}" << std::endl;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "predef.h"
+
+#include <ostream>
+
+#include "parallel.h"
+#include "pipeline_stats.h"
+#include "TypeUtil.h"
+
+// Work and time of one measured frame
+struct FrameSample {
+	std::chrono::nanoseconds time;
+	u64 triangles;
+	u32 textureSwitches;
+	u32 sceneOrderTextureSwitches;
+	PipelineStats pipeline;
+};
+
+// Summary of the measured frames of a benchmark run, times in milliseconds. Percentiles are nearest rank.
+struct BenchmarkReport {
+	uvec2 viewport;
+	size_t warmupFrames;
+	size_t frames;
+	double minMs;
+	double medianMs;
+	double p95Ms;
+	double p99Ms;
+	double maxMs;
+	double meanMs;
+	double trianglesPerSecond;
+	double pixelsPerSecond;
+	// means per frame, see FrameStats
+	double textureSwitches;
+	double sceneOrderTextureSwitches;
+	// summed over the measured frames, only reported with PIPELINE_STATS
+	PipelineStats pipeline;
+	// indexed like the scene's meshes
+	std::vector<PipelineStats> meshPipeline;
+	// job system workers over the measured frames
+	std::vector<WorkerStats> workers;
+};
+
+BenchmarkReport summarizeBenchmark(const uvec2& viewport, size_t warmupFrames, const std::vector<FrameSample>& samples);
+
+void writeBenchmarkJson(std::ostream& out, const BenchmarkReport& report);
@@ -0,0 +1,221 @@
+#include "block_compression.h"
+
+#include <cstring>
+
+namespace {
+
+u16 packRGB565(const vec3& color) {
+	auto r = static_cast<u32>(glm::clamp(color.r, 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+	auto g = static_cast<u32>(glm::clamp(color.g, 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+	auto b = static_cast<u32>(glm::clamp(color.b, 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+	return static_cast<u16>((r << 11) | (g << 5) | b);
+}
+
+glm::u8vec3 unpackRGB565(u16 packed) {
+	u32 r = (packed >> 11) & 0x1F;
+	u32 g = (packed >> 5) & 0x3F;
+	u32 b = packed & 0x1F;
+	return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+}
+
+void colorPalette(u16 c0, u16 c1, bool fourColors, std::array<glm::u8vec3, 4>& palette) {
+	palette[0] = unpackRGB565(c0);
+	palette[1] = unpackRGB565(c1);
+	for (auto c = 0; c < 3; ++c) {
+		u32 p0 = palette[0][c];
+		u32 p1 = palette[1][c];
+		if (fourColors) {
+			palette[2][c] = static_cast<u8>((2 * p0 + p1) / 3);
+			palette[3][c] = static_cast<u8>((p0 + 2 * p1) / 3);
+		} else {
+			palette[2][c] = static_cast<u8>((p0 + p1) / 2);
+			palette[3][c] = 0;
+		}
+	}
+}
+
+void alphaPalette(u8 a0, u8 a1, std::array<u8, 8>& palette) {
+	palette[0] = a0;
+	palette[1] = a1;
+	if (a0 > a1) {
+		for (u32 i = 1; i < 7; ++i) {
+			palette[i + 1] = static_cast<u8>(((7 - i) * a0 + i * a1) / 7);
+		}
+	} else {
+		for (u32 i = 1; i < 5; ++i) {
+			palette[i + 1] = static_cast<u8>(((5 - i) * a0 + i * a1) / 5);
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+// Picks the endpoints from the texels with extreme projections onto the principal axis of the block's colors
+void encodeColorBlock(const u8* rgba, u8* block) {
+	vec3 mean(0.0f);
+	for (u32 i = 0; i < 16; ++i) {
+		mean += vec3(rgba[4 * i + 0], rgba[4 * i + 1], rgba[4 * i + 2]);
+	}
+	mean *= 1.0f / 16;
+
+	glm::mat3 covariance(0.0f);
+	for (u32 i = 0; i < 16; ++i) {
+		auto d = vec3(rgba[4 * i + 0], rgba[4 * i + 1], rgba[4 * i + 2]) - mean;
+		covariance[0] += d * d.x;
+		covariance[1] += d * d.y;
+		covariance[2] += d * d.z;
+	}
+
+	vec3 axis(1.0f, 1.0f, 1.0f);
+	for (auto iteration = 0; iteration < 4; ++iteration) {
+		auto next = covariance * axis;
+		auto len = glm::length(next);
+		if (len < 1e-6f) {
+			break;
+		}
+		axis = next / len;
+	}
+
+	u32 minIdx = 0, maxIdx = 0;
+	float minProj = std::numeric_limits<float>::max();
+	float maxProj = std::numeric_limits<float>::lowest();
+	for (u32 i = 0; i < 16; ++i) {
+		auto proj = dot(vec3(rgba[4 * i + 0], rgba[4 * i + 1], rgba[4 * i + 2]), axis);
+		if (proj < minProj) {
+			minProj = proj;
+			minIdx = i;
+		}
+		if (proj > maxProj) {
+			maxProj = proj;
+			maxIdx = i;
+		}
+	}
+
+	auto c0 = packRGB565(vec3(rgba[4 * maxIdx + 0], rgba[4 * maxIdx + 1], rgba[4 * maxIdx + 2]));
+	auto c1 = packRGB565(vec3(rgba[4 * minIdx + 0], rgba[4 * minIdx + 1], rgba[4 * minIdx + 2]));
+	if (c0 < c1) {
+		std::swap(c0, c1);
+	}
+
+	u32 indices = 0;
+	if (c0 != c1) {
+		std::array<glm::u8vec3, 4> palette;
+		colorPalette(c0, c1, true, palette);
+		for (u32 i = 0; i < 16; ++i) {
+			auto texel = ivec3(rgba[4 * i + 0], rgba[4 * i + 1], rgba[4 * i + 2]);
+			u32 best = 0;
+			auto bestDistance = std::numeric_limits<i32>::max();
+			for (u32 p = 0; p < 4; ++p) {
+				auto d = texel - ivec3(palette[p]);
+				auto distance = dot(d, d);
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= best << (2 * i);
+		}
+	}
+
+	std::memcpy(block + 0, &c0, 2);
+	std::memcpy(block + 2, &c1, 2);
+	std::memcpy(block + 4, &indices, 4);
+}
+
+void decodeColorBlock(const u8* block, bool forceFourColors, u8* rgba) {
+	u16 c0, c1;
+	u32 indices;
+	std::memcpy(&c0, block + 0, 2);
+	std::memcpy(&c1, block + 2, 2);
+	std::memcpy(&indices, block + 4, 4);
+
+	std::array<glm::u8vec3, 4> palette;
+	auto fourColors = forceFourColors || c0 > c1;
+	colorPalette(c0, c1, fourColors, palette);
+	for (u32 i = 0; i < 16; ++i) {
+		auto idx = (indices >> (2 * i)) & 0x3;
+		rgba[4 * i + 0] = palette[idx].r;
+		rgba[4 * i + 1] = palette[idx].g;
+		rgba[4 * i + 2] = palette[idx].b;
+		rgba[4 * i + 3] = (!fourColors && idx == 3) ? 0 : 255;
+	}
+}
+
+}
+
+size_t levelBytes(TextureFormat format, u32 width, u32 height) {
+	if (format == TextureFormat::RGBA8) {
+		return size_t(width) * height * 4;
+	}
+	return size_t(blocksAcross(width)) * blocksAcross(height) * blockBytes(format);
+}
+
+void encodeBC1(const u8* rgba, u8* block) {
+	encodeColorBlock(rgba, block);
+}
+
+void encodeBC3(const u8* rgba, u8* block) {
+	u8 a0 = 0, a1 = 255;
+	for (u32 i = 0; i < 16; ++i) {
+		a0 = std::max(a0, rgba[4 * i + 3]);
+		a1 = std::min(a1, rgba[4 * i + 3]);
+	}
+
+	u64 indices = 0;
+	if (a0 != a1) {
+		std::array<u8, 8> palette;
+		alphaPalette(a0, a1, palette);
+		for (u32 i = 0; i < 16; ++i) {
+			u64 best = 0;
+			auto bestDistance = std::numeric_limits<i32>::max();
+			for (u32 p = 0; p < 8; ++p) {
+				auto distance = std::abs(i32(rgba[4 * i + 3]) - i32(palette[p]));
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= best << (3 * i);
+		}
+	}
+
+	block[0] = a0;
+	block[1] = a1;
+	std::memcpy(block + 2, &indices, 6);
+	encodeColorBlock(rgba, block + 8);
+}
+
+void decodeBC1(const u8* block, u8* rgba) {
+	decodeColorBlock(block, false, rgba);
+}
+
+void decodeBC3(const u8* block, u8* rgba) {
+	decodeColorBlock(block + 8, true, rgba);
+
+	std::array<u8, 8> palette;
+	alphaPalette(block[0], block[1], palette);
+	u64 indices = 0;
+	std::memcpy(&indices, block + 2, 6);
+	for (u32 i = 0; i < 16; ++i) {
+		rgba[4 * i + 3] = palette[(indices >> (3 * i)) & 0x7];
+	}
+}
+
+void compressImage(TextureFormat format, const u8* rgba, u32 width, u32 height, u8* blocks) {
+	auto encode = format == TextureFormat::BC1 ? encodeBC1 : encodeBC3;
+	auto blockSize = blockBytes(format);
+	u8 texels[16 * 4];
+	for (u32 by = 0; by < blocksAcross(height); ++by) {
+		for (u32 bx = 0; bx < blocksAcross(width); ++bx) {
+			for (u32 y = 0; y < BLOCK_DIM; ++y) {
+				auto srcY = std::min(by * BLOCK_DIM + y, height - 1);
+				for (u32 x = 0; x < BLOCK_DIM; ++x) {
+					auto srcX = std::min(bx * BLOCK_DIM + x, width - 1);
+					std::memcpy(texels + 4 * (y * BLOCK_DIM + x), rgba + 4 * (size_t(srcY) * width + srcX), 4);
+				}
+			}
+			encode(texels, blocks);
+			blocks += blockSize;
+		}
+	}
+}
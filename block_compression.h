@@ -0,0 +1,36 @@
+#pragma once
+
+#include "predef.h"
+
+#include "TypeUtil.h"
+
+// Storage format of a texture's mip levels. The block formats hold rows of 4x4 texel blocks: BC1 spends 8 bytes
+// per block on color only, BC3 adds an 8 byte alpha block in front of the color block.
+enum class TextureFormat : u32 {
+	RGBA8,
+	BC1,
+	BC3,
+};
+
+constexpr u32 BLOCK_DIM = 4;
+
+inline size_t blockBytes(TextureFormat format) {
+	return format == TextureFormat::BC1 ? 8 : 16;
+}
+
+inline u32 blocksAcross(u32 texels) {
+	return (texels + BLOCK_DIM - 1) / BLOCK_DIM;
+}
+
+size_t levelBytes(TextureFormat format, u32 width, u32 height);
+
+// rgba points to 16 RGBA8 texels in row major order
+void encodeBC1(const u8* rgba, u8* block);
+void encodeBC3(const u8* rgba, u8* block);
+
+void decodeBC1(const u8* block, u8* rgba);
+void decodeBC3(const u8* block, u8* rgba);
+
+// Encodes a whole RGBA8 image. Blocks hanging over the right or bottom edge repeat the last column or row.
+void compressImage(TextureFormat format, const u8* rgba, u32 width, u32 height, u8* blocks);
+
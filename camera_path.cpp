@@ -0,0 +1,59 @@
+#include "camera_path.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+CameraPath CameraPath::load(const std::string& path) {
+	std::ifstream file(path);
+	if (!file) {
+		std::cerr << "Could not open camera path " << path << std::endl;
+		throw std::runtime_error("camera path not found");
+	}
+
+	CameraPath ret;
+	std::string line;
+	for (size_t lineNumber = 1; std::getline(file, line); ++lineNumber) {
+		auto first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#') {
+			continue;
+		}
+
+		std::istringstream values(line);
+		Camera keyframe;
+		if (!(values >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z
+			>> keyframe.target.x >> keyframe.target.y >> keyframe.target.z)) {
+			std::cerr << "Malformed camera keyframe on line " << lineNumber << " of " << path << std::endl;
+			throw std::runtime_error("malformed camera path");
+		}
+		ret.m_keyframes.push_back(keyframe);
+	}
+
+	if (ret.m_keyframes.empty()) {
+		std::cerr << "Camera path " << path << " has no keyframes" << std::endl;
+		throw std::runtime_error("empty camera path");
+	}
+	return ret;
+}
+
+CameraPath CameraPath::orbit(const Camera& camera, size_t keyframeCount) {
+	CameraPath ret;
+	auto offset = camera.position - camera.target;
+	for (size_t i = 0; i <= keyframeCount; ++i) {
+		auto angle = 2 * float(M_PI) * i / keyframeCount;
+		auto rotated = vec3(offset.x * std::cos(angle) + offset.z * std::sin(angle), offset.y,
+			-offset.x * std::sin(angle) + offset.z * std::cos(angle));
+		ret.m_keyframes.push_back({camera.target + rotated, camera.target});
+	}
+	return ret;
+}
+
+Camera CameraPath::sample(float t) const {
+	auto position = glm::clamp(t, 0.0f, 1.0f) * (m_keyframes.size() - 1);
+	auto segment = std::min(size_t(position), m_keyframes.size() - 1);
+	auto next = std::min(segment + 1, m_keyframes.size() - 1);
+	auto blend = position - segment;
+	return {
+		glm::mix(m_keyframes[segment].position, m_keyframes[next].position, blend),
+		glm::mix(m_keyframes[segment].target, m_keyframes[next].target, blend)};
+}
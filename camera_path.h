@@ -0,0 +1,29 @@
+#pragma once
+
+#include "predef.h"
+
+#include <string>
+
+// Viewpoint periodic renders the scene from
+struct Camera {
+	vec3 position;
+	vec3 target;
+};
+
+// Camera moving through keyframes at constant speed per segment, so a frame's view only depends on where along the
+// path it is and runs along the same path render the same frames
+class CameraPath {
+public:
+	// Reads one keyframe per line as "px py pz tx ty tz", blank lines and lines starting with # are skipped
+	static CameraPath load(const std::string& path);
+	// Circles the camera's position around its target once, keeping its height and distance
+	static CameraPath orbit(const Camera& camera, size_t keyframeCount);
+
+	// The view at t in [0, 1] along the path, interpolated linearly between keyframes
+	Camera sample(float t) const;
+
+	const std::vector<Camera>& keyframes() const { return m_keyframes; }
+
+private:
+	std::vector<Camera> m_keyframes;
+};
@@ -6,5 +6,11 @@ struct Triangle {
 	vec4 v0, v1, v2;
 };
 
+// Clips the polygon verteciesIn, given as barycentric coefficients, against the plane whose signed distance at a
+// coefficient c is dist0 + dist1 * c.x + dist2 * c.y, and returns how many vertices were written to verteciesOut
+size_t clipAgainstPlane(std::array<vec2, 9>& verteciesOut, const std::array<vec2, 9>& verteciesIn, size_t vertexNumIn, float dist0, float dist1, float dist2);
+
+// Clips the triangle against the view volume. Returns the number of vertices of the clipped polygon, whose
+// barycentric coefficients relative to the triangle are written to coeffs, or less than 3 if nothing is left.
 size_t clip(const Triangle& tri, std::array<vec2, 9>& coeffs);
 
@@ -0,0 +1,173 @@
+#include "geometry_pager.h"
+
+#include "trace.h"
+
+namespace {
+
+// Smallest range of stream elements covering every range added to it
+struct Extent {
+	void add(size_t first, size_t count) {
+		if (count > 0) {
+			begin = std::min(begin, first);
+			end = std::max(end, first + count);
+		}
+	}
+
+	size_t begin = std::numeric_limits<size_t>::max();
+	size_t end = 0;
+};
+
+}
+
+GeometryPager::~GeometryPager() {
+	// queued loads return right away, the running ones are waited for since they publish into this object
+	m_cancelLoads = true;
+	std::vector<Job> loads;
+	{
+		std::lock_guard<std::mutex> guard(m_loadLock);
+		loads.swap(m_loads);
+	}
+	for (const auto& load : loads) {
+		waitForJob(load);
+	}
+}
+
+void GeometryPager::attach(const Scene& scene, size_t budgetBytes) {
+	if (budgetBytes > 0 && !scene.mapping.isOpen()) {
+		std::cerr << "Scene geometry is not memory mapped, paging is disabled" << std::endl;
+		budgetBytes = 0;
+	}
+	m_budgetBytes = budgetBytes;
+	m_mapping = &scene.mapping;
+	if (!isPaging()) {
+		return;
+	}
+
+	size_t totalBytes = 0;
+	m_slots.resize(scene.chunks.size());
+	for (size_t i = 0; i < scene.chunks.size(); ++i) {
+		const auto& chunk = scene.chunks[i];
+		auto& slot = m_slots[i];
+		auto addRange = [&slot](const auto& stream, const Extent& extent) {
+			if (extent.end > extent.begin) {
+				auto begin = reinterpret_cast<const u8*>(stream.data() + extent.begin);
+				slot.ranges.push_back({begin, (extent.end - extent.begin) * sizeof(stream[0])});
+			}
+		};
+
+		// levels of detail are stored mesh by mesh after all the full meshes, in the index stream of their mesh
+		Extent vertecies, meshlets, meshletOrders, indices, lodIndices, shortIndices, shortLodIndices;
+		for (const auto& mesh : Span<const Mesh>(scene.meshes).subspan(chunk.baseMesh, chunk.meshCount)) {
+			vertecies.add(mesh.baseVertex, mesh.vertexCount);
+			meshlets.add(mesh.baseMeshlet, mesh.meshletCount);
+			meshletOrders.add(size_t(mesh.baseMeshlet) * MESHLET_ORDER_DIRECTIONS, size_t(mesh.meshletCount) * MESHLET_ORDER_DIRECTIONS);
+			(mesh.shortIndices ? shortIndices : indices).add(mesh.baseIndex, mesh.indexCount);
+			for (const auto& lod : scene.lods.subspan(mesh.baseLod, mesh.lodCount)) {
+				(mesh.shortIndices ? shortLodIndices : lodIndices).add(lod.baseIndex, lod.indexCount);
+			}
+		}
+
+		if (scene.quantized) {
+			addRange(scene.quantizedVertecies, vertecies);
+			addRange(scene.halfTexCoords, vertecies);
+		} else {
+			addRange(scene.vertecies, vertecies);
+			addRange(scene.texCoords, vertecies);
+		}
+		addRange(scene.meshlets, meshlets);
+		addRange(scene.meshletOrders, meshletOrders);
+		addRange(scene.indices, indices);
+		addRange(scene.indices, lodIndices);
+		addRange(scene.shortIndices, shortIndices);
+		addRange(scene.shortIndices, shortLodIndices);
+
+		for (const auto& range : slot.ranges) {
+			slot.bytes += range.size;
+		}
+		totalBytes += slot.bytes;
+	}
+
+	std::cout << "Paging " << m_slots.size() << " geometry chunks (" << totalBytes / (1024 * 1024) << "MB) under a " 
+		<< m_budgetBytes / (1024 * 1024) << "MB budget" << std::endl;
+}
+
+bool GeometryPager::acquire(u32 chunk) {
+	if (!isPaging()) {
+		return true;
+	}
+
+	auto& slot = m_slots[chunk];
+	slot.lastUsedFrame = m_frame;
+	if (slot.resident) {
+		return true;
+	}
+
+	if (!slot.requested) {
+		slot.requested = true;
+		std::lock_guard<std::mutex> guard(m_loadLock);
+		m_loads.push_back(submitJob([this, chunk]() { pageIn(chunk); }));
+	}
+	return false;
+}
+
+void GeometryPager::endFrame() {
+	std::vector<u32> completed;
+	{
+		std::lock_guard<std::mutex> guard(m_loadLock);
+		completed.swap(m_completed);
+		m_loads.erase(std::remove_if(m_loads.begin(), m_loads.end(), jobDone), m_loads.end());
+	}
+
+	for (auto chunk : completed) {
+		m_slots[chunk].resident = true;
+		m_residentBytes += m_slots[chunk].bytes;
+	}
+
+	evictOverBudget();
+	++m_frame;
+}
+
+void GeometryPager::evictOverBudget() {
+	if (!isPaging() || m_residentBytes <= m_budgetBytes) {
+		return;
+	}
+
+	std::vector<u32> candidates;
+	for (u32 chunk = 0; chunk < m_slots.size(); ++chunk) {
+		if (m_slots[chunk].resident && m_slots[chunk].lastUsedFrame < m_frame) {
+			candidates.push_back(chunk);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](u32 a, u32 b) {
+		return m_slots[a].lastUsedFrame < m_slots[b].lastUsedFrame;
+	});
+
+	for (auto chunk : candidates) {
+		if (m_residentBytes <= m_budgetBytes) {
+			break;
+		}
+		auto& slot = m_slots[chunk];
+		for (const auto& range : slot.ranges) {
+			m_mapping->evict(range.begin, range.size);
+		}
+		m_residentBytes -= slot.bytes;
+		slot.resident = false;
+		slot.requested = false;
+	}
+}
+
+void GeometryPager::pageIn(u32 chunk) {
+	if (m_cancelLoads) {
+		return;
+	}
+
+	{
+		TraceScope trace("page in chunk", chunk);
+		for (const auto& range : m_slots[chunk].ranges) {
+			m_mapping->prefetch(range.begin, range.size);
+		}
+	}
+
+	std::lock_guard<std::mutex> guard(m_loadLock);
+	m_completed.push_back(chunk);
+}
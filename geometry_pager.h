@@ -0,0 +1,64 @@
+#pragma once
+
+#include "predef.h"
+
+#include <atomic>
+#include <mutex>
+
+#include "parallel.h"
+#include "scene.h"
+
+// Streams the scene's geometry chunks in and out of memory. Chunk data stays in the memory mapped mesh cache: a
+// job faults a requested chunk's pages in before the chunk is first drawn, and at the end of a frame the
+// least recently used chunks are dropped from memory while more than the budget is resident.
+// Without paging every chunk counts as resident and the mapping is left to the OS.
+// Only rendering is paged: loadScene builds a missing mesh cache from the whole scene in memory, so a scene larger
+// than memory has to have its cache built on a machine it fits on first.
+class GeometryPager {
+public:
+	GeometryPager() = default;
+	~GeometryPager();
+	GeometryPager(const GeometryPager&) = delete;
+	GeometryPager& operator=(const GeometryPager&) = delete;
+
+	// Starts paging the scene's chunks, budgetBytes of 0 disables paging. The scene must outlive the pager.
+	void attach(const Scene& scene, size_t budgetBytes);
+	bool isPaging() const { return m_budgetBytes > 0; }
+
+	// True if the chunk may be drawn, otherwise requests it so it becomes resident in a later frame
+	bool acquire(u32 chunk);
+
+	void endFrame();
+
+	size_t residentBytes() const { return m_residentBytes; }
+
+private:
+	struct ByteRange {
+		const u8* begin;
+		size_t size;
+	};
+
+	struct Slot {
+		// the chunk's data in every stream, only read by page in jobs after attach
+		std::vector<ByteRange> ranges;
+		size_t bytes = 0;
+		bool resident = false;
+		bool requested = false;
+		u32 lastUsedFrame = 0;
+	};
+
+	void pageIn(u32 chunk);
+	void evictOverBudget();
+
+	const MappedFile* m_mapping = nullptr;
+	std::vector<Slot> m_slots;
+	size_t m_budgetBytes = 0;
+	size_t m_residentBytes = 0;
+	u32 m_frame = 1;
+
+	std::mutex m_loadLock;
+	// page in jobs not collected by endFrame yet
+	std::vector<Job> m_loads;
+	std::vector<u32> m_completed;
+	std::atomic<bool> m_cancelLoads{false};
+};
@@ -0,0 +1,50 @@
+#include "golden.h"
+
+#include <stdexcept>
+
+#include <stb/stb_image.h>
+
+std::vector<Color> readImage(const std::string& path, const uvec2& size) {
+	int width, height, numChannels;
+	auto pixels = stbi_load(path.c_str(), &width, &height, &numChannels, 4);
+	if (!pixels) {
+		std::cerr << "Could not read image " << path << ": " << stbi_failure_reason() << std::endl;
+		throw std::runtime_error("image not read");
+	}
+	if (u32(width) != size.x || u32(height) != size.y) {
+		stbi_image_free(pixels);
+		std::cerr << "Image " << path << " is " << width << "x" << height << ", expected " << size.x << "x" << size.y
+			<< std::endl;
+		throw std::runtime_error("image size mismatch");
+	}
+
+	// image files are stored top row first
+	std::vector<Color> ret(size_t(size.x) * size.y);
+	for (u32 y = 0; y < size.y; ++y) {
+		const auto* row = pixels + size_t(size.y - 1 - y) * size.x * 4;
+		for (u32 x = 0; x < size.x; ++x) {
+			ret[y * size.x + x] = {row[4 * x], row[4 * x + 1], row[4 * x + 2], row[4 * x + 3]};
+		}
+	}
+	stbi_image_free(pixels);
+	return ret;
+}
+
+ImageDiff compareImages(const uvec2& size, const Color* actual, const Color* reference, u32 tolerance, std::vector<Color>& diff) {
+	ImageDiff ret;
+	diff.resize(size_t(size.x) * size.y);
+	for (size_t i = 0; i < diff.size(); ++i) {
+		const auto& a = actual[i];
+		const auto& r = reference[i];
+		auto difference = u32(std::max({std::abs(a.r - r.r), std::abs(a.g - r.g), std::abs(a.b - r.b)}));
+		ret.maxDifference = std::max(ret.maxDifference, difference);
+		if (difference > tolerance) {
+			ret.differingPixels++;
+			diff[i] = {u8(128 + difference / 2), 0, 0, 255};
+		} else {
+			auto grey = u8((r.r + r.g + r.b) / 12);
+			diff[i] = {grey, grey, grey, 255};
+		}
+	}
+	return ret;
+}
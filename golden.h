@@ -0,0 +1,25 @@
+#pragma once
+
+#include "predef.h"
+
+#include <string>
+
+#include "converters.h"
+#include "TypeUtil.h"
+
+// How far a rendered frame is from its reference image
+struct ImageDiff {
+	// pixels with a channel further off than the tolerance
+	u64 differingPixels = 0;
+	// largest difference of any channel, alpha ignored
+	u32 maxDifference = 0;
+};
+
+// Reads a PNG or PPM image of the given size into a color buffer, bottom row first like the renderer's. Throws if the
+// file is missing, unreadable or of another size.
+std::vector<Color> readImage(const std::string& path, const uvec2& size);
+
+// Compares two color buffers pixel by pixel, allowing every channel to be off by up to tolerance. The diff image
+// shows the reference darkened and greyed out, with the pixels beyond the tolerance in red, brighter the further off
+// they are.
+ImageDiff compareImages(const uvec2& size, const Color* actual, const Color* reference, u32 tolerance, std::vector<Color>& diff);
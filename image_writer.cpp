@@ -0,0 +1,292 @@
+#include "image_writer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+// Deflate matches reach back at most WINDOW bytes and are MIN_MATCH to MAX_MATCH bytes long
+constexpr size_t WINDOW = 32768;
+constexpr size_t MIN_MATCH = 3;
+constexpr size_t MAX_MATCH = 258;
+// Earlier positions with the same hash tried per match, trading compression for speed
+constexpr size_t MAX_CHAIN = 32;
+constexpr u32 HASH_BITS = 15;
+
+constexpr u16 LENGTH_BASE[] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr u8 LENGTH_EXTRA[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr u16 DISTANCE_BASE[] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+	8193, 12289, 16385, 24577};
+constexpr u8 DISTANCE_EXTRA[] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Packs deflate's bit stream, whose values go in least significant bit first and whose Huffman codes most
+// significant bit first
+class BitWriter {
+public:
+	explicit BitWriter(std::vector<u8>& out) : m_out(out) {}
+
+	void bits(u32 value, u32 count) {
+		m_buffer |= u64(value) << m_count;
+		m_count += count;
+		while (m_count >= 8) {
+			m_out.push_back(u8(m_buffer));
+			m_buffer >>= 8;
+			m_count -= 8;
+		}
+	}
+
+	void code(u32 code, u32 length) {
+		u32 reversed = 0;
+		for (u32 i = 0; i < length; ++i) {
+			reversed |= ((code >> i) & 1) << (length - 1 - i);
+		}
+		bits(reversed, length);
+	}
+
+	void flush() {
+		if (m_count > 0) {
+			m_out.push_back(u8(m_buffer));
+		}
+		m_buffer = 0;
+		m_count = 0;
+	}
+
+private:
+	std::vector<u8>& m_out;
+	u64 m_buffer = 0;
+	u32 m_count = 0;
+};
+
+// Literal and length symbol in the fixed Huffman code
+void writeSymbol(BitWriter& writer, u32 symbol) {
+	if (symbol < 144) {
+		writer.code(0x30 + symbol, 8);
+	} else if (symbol < 256) {
+		writer.code(0x190 + symbol - 144, 9);
+	} else if (symbol < 280) {
+		writer.code(symbol - 256, 7);
+	} else {
+		writer.code(0xc0 + symbol - 280, 8);
+	}
+}
+
+void writeMatch(BitWriter& writer, size_t length, size_t distance) {
+	auto lengthCode = size_t(std::upper_bound(std::begin(LENGTH_BASE), std::end(LENGTH_BASE), length) - LENGTH_BASE) - 1;
+	writeSymbol(writer, u32(257 + lengthCode));
+	writer.bits(u32(length - LENGTH_BASE[lengthCode]), LENGTH_EXTRA[lengthCode]);
+
+	auto distanceCode =
+		size_t(std::upper_bound(std::begin(DISTANCE_BASE), std::end(DISTANCE_BASE), distance) - DISTANCE_BASE) - 1;
+	writer.code(u32(distanceCode), 5);
+	writer.bits(u32(distance - DISTANCE_BASE[distanceCode]), DISTANCE_EXTRA[distanceCode]);
+}
+
+// Deflates data into one block of fixed Huffman codes, taking the longest match among recent positions with the
+// same 3 byte hash. Rendered frames are mostly runs and repeats, which this catches without building codes.
+void deflateFixed(const std::vector<u8>& data, std::vector<u8>& out) {
+	BitWriter writer(out);
+	// final block, fixed Huffman codes
+	writer.bits(1, 1);
+	writer.bits(1, 2);
+
+	auto hash = [&](size_t i) {
+		u32 value = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16);
+		return (value * 2654435761u) >> (32 - HASH_BITS);
+	};
+	constexpr auto NONE = ~size_t(0);
+	std::vector<size_t> head(size_t(1) << HASH_BITS, NONE);
+	std::vector<size_t> previous(WINDOW, NONE);
+	auto insert = [&](size_t i) {
+		if (i + MIN_MATCH <= data.size()) {
+			auto h = hash(i);
+			previous[i % WINDOW] = head[h];
+			head[h] = i;
+		}
+	};
+
+	for (size_t i = 0; i < data.size();) {
+		size_t bestLength = 0;
+		size_t bestDistance = 0;
+		if (i + MIN_MATCH <= data.size()) {
+			auto maxLength = std::min(MAX_MATCH, data.size() - i);
+			auto candidate = head[hash(i)];
+			for (size_t chain = 0; chain < MAX_CHAIN && candidate != NONE && i - candidate <= WINDOW; ++chain) {
+				size_t length = 0;
+				while (length < maxLength && data[candidate + length] == data[i + length]) {
+					++length;
+				}
+				if (length > bestLength) {
+					bestLength = length;
+					bestDistance = i - candidate;
+					if (length == maxLength) {
+						break;
+					}
+				}
+				auto next = previous[candidate % WINDOW];
+				// slots are reused once the window moves on, older entries only ever point further back
+				candidate = next < candidate ? next : NONE;
+			}
+		}
+
+		if (bestLength >= MIN_MATCH) {
+			writeMatch(writer, bestLength, bestDistance);
+			for (size_t j = 0; j < bestLength; ++j) {
+				insert(i + j);
+			}
+			i += bestLength;
+		} else {
+			writeSymbol(writer, data[i]);
+			insert(i);
+			++i;
+		}
+	}
+
+	// end of block
+	writeSymbol(writer, 256);
+	writer.flush();
+}
+
+// Filters a row for compression, choosing between none, sub and up by the smallest sum of the filtered bytes taken
+// as signed, the usual heuristic. Appends the filter type and the filtered bytes.
+void appendFilteredRow(const u8* row, const u8* above, size_t rowBytes, std::vector<u8>& out) {
+	auto filtered = [&](u8 filter, size_t i) -> u8 {
+		auto left = i >= sizeof(Color) ? row[i - sizeof(Color)] : 0;
+		auto up = above ? above[i] : 0;
+		return u8(row[i] - (filter == 1 ? left : filter == 2 ? up : 0));
+	};
+
+	u8 bestFilter = 0;
+	u64 bestSum = ~u64(0);
+	for (u8 filter = 0; filter < 3; ++filter) {
+		u64 sum = 0;
+		for (size_t i = 0; i < rowBytes; ++i) {
+			sum += std::abs(int8_t(filtered(filter, i)));
+		}
+		if (sum < bestSum) {
+			bestSum = sum;
+			bestFilter = filter;
+		}
+	}
+
+	out.push_back(bestFilter);
+	for (size_t i = 0; i < rowBytes; ++i) {
+		out.push_back(filtered(bestFilter, i));
+	}
+}
+
+u32 crc32(const u8* data, size_t size, u32 crc = 0) {
+	static const auto TABLE = [] {
+		std::array<u32, 256> ret;
+		for (u32 n = 0; n < 256; ++n) {
+			auto c = n;
+			for (auto k = 0; k < 8; ++k) {
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			ret[n] = c;
+		}
+		return ret;
+	}();
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i) {
+		crc = TABLE[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+u32 adler32(const u8* data, size_t size) {
+	constexpr u32 MOD = 65521;
+	u32 a = 1, b = 0;
+	for (size_t i = 0; i < size; ++i) {
+		a = (a + data[i]) % MOD;
+		b = (b + a) % MOD;
+	}
+	return (b << 16) | a;
+}
+
+void appendBigEndian(std::vector<u8>& out, u32 value) {
+	out.insert(out.end(), {u8(value >> 24), u8(value >> 16), u8(value >> 8), u8(value)});
+}
+
+void writeChunk(std::ostream& out, const char* type, const std::vector<u8>& data) {
+	std::vector<u8> chunk;
+	appendBigEndian(chunk, u32(data.size()));
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	// the checksum covers the type and the data but not the length
+	appendBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+	out.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+}
+
+}
+
+void writePpm(std::ostream& out, const uvec2& size, const Color* colors) {
+	out << "P6\n" << size.x << " " << size.y << "\n255\n";
+	std::vector<u8> row(size.x * 3);
+	for (auto y = size.y; y-- > 0;) {
+		for (u32 x = 0; x < size.x; ++x) {
+			const auto& color = colors[y * size.x + x];
+			row[3 * x] = color.r;
+			row[3 * x + 1] = color.g;
+			row[3 * x + 2] = color.b;
+		}
+		out.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+}
+
+void writePng(std::ostream& out, const uvec2& size, const Color* colors) {
+	static const u8 SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	out.write(reinterpret_cast<const char*>(SIGNATURE), sizeof(SIGNATURE));
+
+	std::vector<u8> header;
+	appendBigEndian(header, size.x);
+	appendBigEndian(header, size.y);
+	// 8 bits per channel RGBA, default compression and filter methods, not interlaced
+	header.insert(header.end(), {8, 6, 0, 0, 0});
+	writeChunk(out, "IHDR", header);
+
+	// every row starts with its filter type, the rows above are the ones written before
+	auto rowBytes = size_t(size.x) * sizeof(Color);
+	std::vector<u8> raw;
+	raw.reserve((rowBytes + 1) * size.y);
+	const u8* above = nullptr;
+	for (auto y = size.y; y-- > 0;) {
+		auto row = reinterpret_cast<const u8*>(colors + size_t(y) * size.x);
+		appendFilteredRow(row, above, rowBytes, raw);
+		above = row;
+	}
+
+	// zlib stream of a single deflate block
+	std::vector<u8> data = {0x78, 0x01};
+	deflateFixed(raw, data);
+	appendBigEndian(data, adler32(raw.data(), raw.size()));
+	writeChunk(out, "IDAT", data);
+
+	writeChunk(out, "IEND", {});
+}
+
+void writeImage(const std::string& path, const uvec2& size, const Color* colors) {
+	std::ofstream out(path, std::ios::binary);
+	if (!out) {
+		std::cerr << "Could not open " << path << " for writing" << std::endl;
+		throw std::runtime_error("image not written");
+	}
+
+	auto png = path.size() >= 4 && path.compare(path.size() - 4, 4, ".png") == 0;
+	if (png) {
+		writePng(out, size, colors);
+	} else {
+		writePpm(out, size, colors);
+	}
+
+	if (!out) {
+		std::cerr << "Could not write " << path << std::endl;
+		throw std::runtime_error("image not written");
+	}
+}
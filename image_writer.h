@@ -0,0 +1,21 @@
+#pragma once
+
+#include "predef.h"
+
+#include <ostream>
+#include <string>
+
+#include "converters.h"
+#include "TypeUtil.h"
+
+// Color buffers are stored bottom row first, as drawn by glDrawPixels, and are written top row first.
+
+// Binary PPM (P6), alpha is dropped. Several images written to one stream form a sequence ffmpeg can read.
+void writePpm(std::ostream& out, const uvec2& size, const Color* colors);
+
+// RGBA PNG. Image data is deflated with fixed Huffman codes only, which keeps the writer small and free of
+// dependencies while still shrinking the long runs of rendered frames.
+void writePng(std::ostream& out, const uvec2& size, const Color* colors);
+
+// Writes a PNG if the path ends in ".png" and a PPM otherwise
+void writeImage(const std::string& path, const uvec2& size, const Color* colors);
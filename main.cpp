@@ -1,60 +1,549 @@
 #include "predef.h"
 
+#include <charconv>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <sstream>
+
+#include "benchmark.h"
+#include "camera_path.h"
 #include "converters.h"
+#include "golden.h"
+#include "image_writer.h"
+#include "options.h"
+#include "parallel.h"
+#include "overdraw.h"
+#include "rasterizer.h"
+#include "trace.h"
+#ifdef RASTER_WITH_WINDOW
 #include "util.h"
+#endif
 
 #include "user_data.h"
 
-void init(const uvec2& viewport);
-void periodic(GLFWwindow* window, const uvec2& viewport, float* depthBuffer, Color* colorBuffer);
+// Parses the number following the flag at i, which has to take up the whole argument, and steps i over it.
+// Reports what the flag expects if the number is missing or malformed.
+template <typename T>
+bool parseNumber(const std::vector<std::string>& args, size_t& i, const char* expected, T& value) {
+	auto parsed = false;
+	if (i + 1 < args.size()) {
+		const auto& text = args[i + 1];
+		auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+		parsed = !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+	}
+	if (!parsed) {
+		std::cerr << args[i] << " expects " << expected << std::endl;
+		return false;
+	}
+	++i;
+	return true;
+}
 
-void parseArguments(const std::vector<std::string>& args, bool& renderOnce) {
-	renderOnce = false;
-	for (const auto& arg : args) {
+bool parseArguments(const std::vector<std::string>& args, Options& options) {
+	for (size_t i = 0; i < args.size(); ++i) {
+		const auto& arg = args[i];
 		if (arg == "-once") {
-			renderOnce = true;
+			options.renderOnce = true;
+		} else if (arg == "-headless") {
+			options.headless = true;
+		} else if (arg == "-frames") {
+			if (!parseNumber(args, i, "a frame count", options.frameCount)) {
+				return false;
+			}
+		} else if (arg == "-output") {
+			if (i + 1 == args.size()) {
+				std::cerr << "-output expects an image file, or - for stdout" << std::endl;
+				return false;
+			}
+			options.outputPath = args[++i];
+		} else if (arg == "-benchmark") {
+			if (!parseNumber(args, i, "a frame count", options.benchmarkFrames)) {
+				return false;
+			}
+		} else if (arg == "-warmup") {
+			if (!parseNumber(args, i, "a frame count", options.warmupFrames)) {
+				return false;
+			}
+		} else if (arg == "-camera-path") {
+			if (i + 1 == args.size()) {
+				std::cerr << "-camera-path expects a keyframe file" << std::endl;
+				return false;
+			}
+			options.cameraPath = args[++i];
+		} else if (arg == "-benchmark-output") {
+			if (i + 1 == args.size()) {
+				std::cerr << "-benchmark-output expects a file, or - for stdout" << std::endl;
+				return false;
+			}
+			options.benchmarkOutput = args[++i];
+		} else if (arg == "-scene") {
+			if (i + 1 == args.size()) {
+				std::cerr << "-scene expects an OBJ file in the resources directory" << std::endl;
+				return false;
+			}
+			options.scenePath = args[++i];
+		} else if (arg == "-golden") {
+			if (i + 1 == args.size()) {
+				std::cerr << "-golden expects a directory of reference images" << std::endl;
+				return false;
+			}
+			options.goldenDir = args[++i];
+		} else if (arg == "-update-golden") {
+			options.updateGolden = true;
+		} else if (arg == "-golden-tolerance") {
+			if (!parseNumber(args, i, "a difference per color channel", options.goldenTolerance)) {
+				return false;
+			}
+		} else if (arg == "-overdraw") {
+			options.overdraw = true;
+		} else if (arg == "-trace") {
+			if (i + 1 == args.size()) {
+				std::cerr << "-trace expects a file for the Chrome trace" << std::endl;
+				return false;
+			}
+			options.tracePath = args[++i];
+		} else if (arg == "-workers") {
+			if (!parseNumber(args, i, "a worker thread count", options.workerCount)) {
+				return false;
+			}
+		} else if (arg == "-pin-workers") {
+			options.pinWorkers = true;
+		} else if (arg == "-pipelined") {
+			options.pipelined = true;
+		} else if (arg == "-lazy-textures") {
+			options.lazyTextures = true;
+		} else if (arg == "-compressed-textures") {
+			options.compressedTextures = true;
+		} else if (arg == "-optimize-meshes") {
+			options.optimizeMeshes = true;
+		} else if (arg == "-quantize-vertices") {
+			options.quantizedVertices = true;
+		} else if (arg == "-draw-order") {
+			static const std::map<std::string, DrawOrder> DRAW_ORDERS = {
+				{"scene", DrawOrder::Scene}, {"texture", DrawOrder::Texture}, {"front-to-back", DrawOrder::FrontToBack}};
+			auto order = i + 1 < args.size() ? DRAW_ORDERS.find(args[i + 1]) : DRAW_ORDERS.end();
+			if (order == DRAW_ORDERS.end()) {
+				std::cerr << "-draw-order expects scene, texture or front-to-back" << std::endl;
+				return false;
+			}
+			options.drawOrder = order->second;
+			++i;
+		} else if (arg == "-no-cluster-culling") {
+			options.clusterCulling = false;
+		} else if (arg == "-texture-budget") {
+			size_t megabytes;
+			if (!parseNumber(args, i, "a size in MB", megabytes)) {
+				return false;
+			}
+			options.textureBudget = megabytes * 1024 * 1024;
+		} else if (arg == "-geometry-budget") {
+			size_t megabytes;
+			if (!parseNumber(args, i, "a size in MB", megabytes)) {
+				return false;
+			}
+			options.geometryBudget = megabytes * 1024 * 1024;
+		} else if (arg == "-lod-error") {
+			if (!parseNumber(args, i, "an RMS error estimate in pixels", options.lodErrorPixels)) {
+				return false;
+			}
 		}
 	}
+
+	return true;
 }
 
-int main(int argc, const char** argv) {
-	const uvec2 VIEWPORT{1280, 720};
-	const float DEPTH_BUFFER_CLEAR = std::numeric_limits<float>::max();
-	const Color COLOR_BUFFER_CLEAR = {0, 0, 0, 1};
-	bool renderOnce;
-	parseArguments(std::vector<std::string>(argv, argv + argc), renderOnce);
-	std::vector<float> depthBuffer(VIEWPORT.x * VIEWPORT.y, DEPTH_BUFFER_CLEAR);
-	std::vector<Color> colorBuffer(VIEWPORT.x * VIEWPORT.y, COLOR_BUFFER_CLEAR);
-	std::chrono::milliseconds frameWait(30);
-
-	auto window = setupGlfw(VIEWPORT.x, VIEWPORT.y);
+// Renders into the CPU buffers, optionally logging the frame time every now and then.
+// Pipelined, frames go through three stages at once: while the caller presents the frame completed by a render
+// call, the next frame rasterizes into the other pair of targets and the one after it is prepared from the camera
+// set before the call. A frame thus comes out two render calls after it was started, and flush completes the
+// frames still in flight.
+class FrameRenderer {
+public:
+	explicit FrameRenderer(const uvec2& viewport, bool logFrameTimes = true, bool pipelined = false) :
+		m_viewport(viewport),
+		m_logFrameTimes(logFrameTimes),
+		m_pipelined(pipelined),
+		m_lastFrameLogTime(std::chrono::steady_clock::now()) {
+		for (size_t i = 0; i < (pipelined ? 2 : 1); ++i) {
+			m_targets[i].depth.assign(viewport.x * viewport.y, DEPTH_BUFFER_CLEAR);
+			m_targets[i].color.assign(viewport.x * viewport.y, COLOR_BUFFER_CLEAR);
+		}
+	}
+
+	~FrameRenderer() {
+		// jobs in flight write into the targets, their errors no longer matter
+		for (const auto& job : {m_raster, m_geometry}) {
+			if (job) {
+				try {
+					waitForJob(job);
+				} catch (const std::exception&) {
+				}
+			}
+		}
+	}
+
+	FrameRenderer(const FrameRenderer&) = delete;
+	FrameRenderer& operator=(const FrameRenderer&) = delete;
+
+	// Returns how long the frame took, clearing the buffers included. Pipelined, returns how long the call took.
+	std::chrono::nanoseconds render() {
+		TraceScope trace("frame", m_frame);
+		auto start = std::chrono::steady_clock::now();
+		if (m_pipelined) {
+			renderPipelined();
+		} else {
+			auto& targets = m_targets[0];
+			clearTargets(m_viewport, targets.depth.data(), targets.color.data());
+			if constexpr (OVERDRAW) {
+				clearOverdraw();
+			}
+			periodic(m_viewport, targets.depth.data(), targets.color.data());
+			m_frameReady = true;
+		}
+		++m_frame;
+
+		auto end = std::chrono::steady_clock::now();
+		if (m_logFrameTimes && (end - m_lastFrameLogTime) > std::chrono::milliseconds(500)) {
+			auto took = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+			std::cout << "Frame rendering took " << took.count() << "us" << std::endl;
+			m_lastFrameLogTime = end;
+		}
+		return end - start;
+	}
+
+	// Completes the oldest frame in flight, returns false if there is none
+	bool flush() {
+		m_frameReady = false;
+		if (!m_raster && !m_geometry) {
+			return false;
+		}
+		if (!m_raster) {
+			startRaster();
+		}
+		completeRaster();
+		if (m_geometry) {
+			startRaster();
+		}
+		return true;
+	}
+
+	// Whether the last render or flush call completed a frame, which colors() then shows
+	bool frameReady() const { return m_frameReady; }
+
+	const Color* colors() const { return m_targets[m_shownTargets].color.data(); }
+
+private:
+	struct Targets {
+		std::vector<float> depth;
+		std::vector<Color> color;
+	};
+
+	void renderPipelined() {
+		m_frameReady = false;
+		if (m_raster) {
+			completeRaster();
+		}
+
+		std::vector<Job> dependencies;
+		if (m_geometry) {
+			dependencies.push_back(m_geometry);
+		}
+		auto frame = m_frame;
+		auto viewport = m_viewport;
+		auto geometry = submitJob([frame, viewport, camera = camera()]() {
+			TraceScope trace("prepare", frame);
+			prepareFrame(viewport, camera, frame % 2);
+		}, dependencies);
+
+		if (m_geometry) {
+			startRaster();
+		}
+		m_geometry = geometry;
+		m_geometryFrame = frame;
+	}
+
+	// Rasterizes the prepared frame once its preparation finished
+	void startRaster() {
+		auto frame = m_geometryFrame;
+		m_raster = submitJob([this, frame]() {
+			TraceScope trace("rasterize", frame);
+			auto& targets = m_targets[frame % 2];
+			clearTargets(m_viewport, targets.depth.data(), targets.color.data());
+			rasterFrame(m_viewport, frame % 2, targets.depth.data(), targets.color.data());
+		}, {m_geometry});
+		m_rasterFrame = frame;
+		m_geometry = nullptr;
+	}
+
+	void completeRaster() {
+		auto raster = std::move(m_raster);
+		m_raster = nullptr;
+		waitForJob(raster);
+		finishFrame(m_rasterFrame % 2);
+		m_shownTargets = m_rasterFrame % 2;
+		m_frameReady = true;
+	}
+
+	uvec2 m_viewport;
+	std::array<Targets, 2> m_targets;
+	bool m_logFrameTimes;
+	bool m_pipelined;
+	size_t m_frame = 0;
+	std::chrono::steady_clock::time_point m_lastFrameLogTime;
+
+	bool m_frameReady = false;
+	size_t m_shownTargets = 0;
+	// the frame being prepared and the one being rasterized, null when there is none
+	Job m_geometry;
+	size_t m_geometryFrame = 0;
+	Job m_raster;
+	size_t m_rasterFrame = 0;
+};
+
+// Moves the log written to std::cout over to stderr while alive, so data can go to the original stdout
+class LogToStderr {
+public:
+	LogToStderr() : m_stdout(std::cout.rdbuf(std::cerr.rdbuf())) {}
+	~LogToStderr() { std::cout.rdbuf(m_stdout); }
+	LogToStderr(const LogToStderr&) = delete;
+	LogToStderr& operator=(const LogToStderr&) = delete;
+
+	std::streambuf* stdoutBuffer() const { return m_stdout; }
+
+private:
+	std::streambuf* m_stdout;
+};
+
+// Where the extension of the path's file name starts, or its end if it has none
+size_t extensionStart(const std::string& path) {
+	auto dot = path.find_last_of('.');
+	auto slash = path.find_last_of('/');
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return path.size();
+	}
+	return dot;
+}
+
+std::string withoutExtension(const std::string& path) {
+	return path.substr(0, extensionStart(path));
+}
+
+// The output path of a frame, numbered before the extension when a run writes several frames
+std::string framePath(const std::string& outputPath, size_t frame, size_t frameCount) {
+	if (frameCount == 1) {
+		return outputPath;
+	}
+
+	auto dot = extensionStart(outputPath);
+	std::ostringstream ret;
+	ret << outputPath.substr(0, dot) << "_" << std::setw(4) << std::setfill('0') << frame << outputPath.substr(dot);
+	return ret.str();
+}
+
+int runHeadless(const uvec2& viewport, const Options& options) {
+	// frames streamed to stdout must not be interleaved with the log
+	auto toStdout = options.outputPath == "-";
+	std::optional<LogToStderr> redirect;
+	if (toStdout) {
+		redirect.emplace();
+	}
+	std::ostream imageStream(toStdout ? redirect->stdoutBuffer() : nullptr);
+
+	if (options.overdraw && toStdout) {
+		std::cerr << "-overdraw needs an output file to write its images next to" << std::endl;
+		return EXIT_FAILURE;
+	}
+	// overdraw is counted into one set of counters, so frames must not overlap
+	auto pipelined = options.pipelined && !options.overdraw;
+	if (options.pipelined && !pipelined) {
+		std::cerr << "-overdraw renders frames one at a time, ignoring -pipelined" << std::endl;
+	}
+
+	FrameRenderer renderer(viewport, true, pipelined);
+	init(viewport, options);
+	if (options.overdraw) {
+		enableOverdraw(viewport);
+	}
+
+	size_t written = 0;
+	auto writeFrame = [&]() {
+		if (toStdout) {
+			writePpm(imageStream, viewport, renderer.colors());
+			imageStream.flush();
+		} else {
+			auto path = framePath(options.outputPath, written, options.frameCount);
+			writeImage(path, viewport, renderer.colors());
+			if (options.overdraw) {
+				writeOverdraw(withoutExtension(path));
+			}
+		}
+		++written;
+	};
+	for (size_t frame = 0; frame < options.frameCount; ++frame) {
+		renderer.render();
+		if (renderer.frameReady()) {
+			writeFrame();
+		}
+	}
+	while (renderer.flush()) {
+		writeFrame();
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Renders the warm-up and then the measured frames along the camera path and reports their statistics. Frames are
+// placed along the path by their number rather than by time, so every run renders the same views.
+int runBenchmark(const uvec2& viewport, const Options& options) {
+	// keyframes of the default orbit around the scene
+	constexpr size_t ORBIT_KEYFRAMES = 16;
+
+	auto toStdout = options.benchmarkOutput == "-";
+	std::optional<LogToStderr> redirect;
+	if (toStdout) {
+		redirect.emplace();
+	}
+
+	FrameRenderer renderer(viewport, false, options.pipelined);
+	init(viewport, options);
+	auto path = options.cameraPath.empty() ? CameraPath::orbit(camera(), ORBIT_KEYFRAMES) : CameraPath::load(options.cameraPath);
+	auto pathPosition = [](size_t frame, size_t frameCount) {
+		return frameCount > 1 ? float(frame) / (frameCount - 1) : 0.0f;
+	};
+
+	// the warm-up flies the whole path, so what the measured frames need is loaded by the time they start
+	for (size_t frame = 0; frame < options.warmupFrames; ++frame) {
+		setCamera(path.sample(pathPosition(frame, options.warmupFrames)));
+		renderer.render();
+	}
+	// warm-up frames still in flight must not finish among the measured ones
+	while (renderer.flush()) {
+	}
+	takeWorkerStats();
+
+	// the statistics are those of the frame the last render or flush completed. Pipelined, a frame's time is the
+	// time since the previous one completed, as the frames overlap.
+	std::vector<FrameSample> samples;
+	std::vector<PipelineStats> meshPipeline;
+	auto lastCompleted = std::chrono::steady_clock::now();
+	auto recordFrame = [&](std::chrono::nanoseconds time) {
+		auto now = std::chrono::steady_clock::now();
+		if (options.pipelined) {
+			time = now - lastCompleted;
+		}
+		lastCompleted = now;
+		const auto& stats = lastFrameStats();
+		samples.push_back({time, stats.triangles, stats.textureSwitches, stats.sceneOrderTextureSwitches, stats.pipeline});
+
+		auto meshStats = lastFrameMeshPipelineStats();
+		meshPipeline.resize(meshStats.size());
+		for (size_t mesh = 0; mesh < meshStats.size(); ++mesh) {
+			meshPipeline[mesh] += meshStats[mesh];
+		}
+	};
+	for (size_t frame = 0; frame < options.benchmarkFrames; ++frame) {
+		setCamera(path.sample(pathPosition(frame, options.benchmarkFrames)));
+		auto time = renderer.render();
+		if (renderer.frameReady()) {
+			recordFrame(time);
+		}
+	}
+	while (renderer.flush()) {
+		recordFrame(std::chrono::nanoseconds(0));
+	}
+
+	auto report = summarizeBenchmark(viewport, options.warmupFrames, samples);
+	report.meshPipeline = std::move(meshPipeline);
+	report.workers = takeWorkerStats();
+	if (toStdout) {
+		std::ostream out(redirect->stdoutBuffer());
+		writeBenchmarkJson(out, report);
+	} else {
+		std::ofstream out(options.benchmarkOutput);
+		writeBenchmarkJson(out, report);
+		if (!out) {
+			std::cerr << "Could not write " << options.benchmarkOutput << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+// Renders one frame per camera keyframe and compares it against, or with -update-golden replaces, its reference
+// "<golden dir>/<scene>_<keyframe>.png". Returns failure if any frame is off its reference.
+int runGolden(const uvec2& viewport, Options options) {
+	// a frame has to come out the same however long loading takes, so nothing is loaded in the background
+	options.lazyTextures = false;
+	options.textureBudget = 0;
+	options.geometryBudget = 0;
+
+	FrameRenderer renderer(viewport, false);
+	init(viewport, options);
+	auto cameras = options.cameraPath.empty() ? std::vector<Camera>{camera()} : CameraPath::load(options.cameraPath).keyframes();
+	auto sceneName = withoutExtension(options.scenePath.substr(options.scenePath.find_last_of('/') + 1));
+
+	size_t failed = 0;
+	std::vector<Color> diff;
+	for (size_t i = 0; i < cameras.size(); ++i) {
+		std::ostringstream stem;
+		stem << options.goldenDir << "/" << sceneName << "_" << std::setw(2) << std::setfill('0') << i;
+		auto referencePath = stem.str() + ".png";
+
+		setCamera(cameras[i]);
+		renderer.render();
+		if (options.updateGolden) {
+			writeImage(referencePath, viewport, renderer.colors());
+			std::cout << "Wrote reference " << referencePath << std::endl;
+			continue;
+		}
+
+		auto reference = readImage(referencePath, viewport);
+		auto result = compareImages(viewport, renderer.colors(), reference.data(), options.goldenTolerance, diff);
+		if (result.differingPixels == 0) {
+			std::cout << "Matched " << referencePath << ", channels off by up to " << result.maxDifference << std::endl;
+			continue;
+		}
+
+		++failed;
+		writeImage(stem.str() + "_actual.png", viewport, renderer.colors());
+		writeImage(stem.str() + "_diff.png", viewport, diff.data());
+		std::cerr << "Mismatch against " << referencePath << ": " << result.differingPixels
+			<< " pixels off by more than " << options.goldenTolerance << ", channels off by up to "
+			<< result.maxDifference << ", see " << stem.str() << "_diff.png" << std::endl;
+	}
+
+	if (failed > 0) {
+		std::cerr << failed << " of " << cameras.size() << " golden images do not match" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+#ifdef RASTER_WITH_WINDOW
+int runWindowed(const uvec2& viewport, const Options& options) {
+	auto window = setupGlfw(viewport.x, viewport.y);
 	if (!window) {
 		std::cerr << "could not init GLFW" << std::endl;
 		return EXIT_FAILURE;
 	}
 
-	init(VIEWPORT);
+	FrameRenderer renderer(viewport, true, options.pipelined);
+	init(viewport, options);
 	
-	auto lastFrameLogTime = std::chrono::high_resolution_clock::now();
 	auto rendered = false;
 	while (!glfwWindowShouldClose(window)) {
-		if (renderOnce && rendered) {
+		if (options.renderOnce && rendered) {
 			glfwPollEvents();
 			continue;
 		}
 		
-		auto start = std::chrono::high_resolution_clock::now();
-		std::fill(depthBuffer.begin(), depthBuffer.end(), DEPTH_BUFFER_CLEAR);
-		std::fill(colorBuffer.begin(), colorBuffer.end(), COLOR_BUFFER_CLEAR);
-
-		periodic(window, VIEWPORT, depthBuffer.data(), colorBuffer.data());
-		auto end = std::chrono::high_resolution_clock::now();
-		if ((end - lastFrameLogTime) > std::chrono::milliseconds(500)) {
-			std::cout << "Frame rendering took " << ((end - start).count()) / 1000 << "us" << std::endl;
-			lastFrameLogTime = end;
+		renderer.render();
+		if (!renderer.frameReady()) {
+			glfwPollEvents();
+			continue;
 		}
-
-		glDrawPixels(VIEWPORT.x, VIEWPORT.y, GL_RGBA, GL_UNSIGNED_BYTE, colorBuffer.data());
+		glDrawPixels(viewport.x, viewport.y, GL_RGBA, GL_UNSIGNED_BYTE, renderer.colors());
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
@@ -64,4 +553,41 @@ int main(int argc, const char** argv) {
 
 	glfwDestroyWindow(window);
 	glfwTerminate();
+	return EXIT_SUCCESS;
+}
+#endif
+
+int run(const uvec2& viewport, const Options& options) {
+	if (!options.goldenDir.empty()) {
+		return runGolden(viewport, options);
+	}
+	if (options.benchmarkFrames > 0) {
+		return runBenchmark(viewport, options);
+	}
+#ifdef RASTER_WITH_WINDOW
+	if (!options.headless) {
+		return runWindowed(viewport, options);
+	}
+#endif
+	return runHeadless(viewport, options);
+}
+
+int main(int argc, const char** argv) {
+	const uvec2 VIEWPORT{1280, 720};
+	Options options;
+	if (!parseArguments(std::vector<std::string>(argv, argv + argc), options)) {
+		return EXIT_FAILURE;
+	}
+
+	configureJobSystem(options.workerCount, options.pinWorkers);
+	if (!options.tracePath.empty()) {
+		setTraceThreadName("main");
+		enableTracing(true);
+	}
+	auto ret = run(VIEWPORT, options);
+	if (tracingEnabled()) {
+		enableTracing(false);
+		writeChromeTrace(options.tracePath);
+	}
+	return ret;
 }
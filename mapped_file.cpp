@@ -0,0 +1,144 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) {
+	auto fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cerr << "Could not open file: " << path << std::endl;
+		throw std::runtime_error("file open failed");
+	}
+
+	struct stat info;
+	if (::fstat(fd, &info) != 0) {
+		::close(fd);
+		std::cerr << "Could not stat file: " << path << std::endl;
+		throw std::runtime_error("file stat failed");
+	}
+
+	m_size = static_cast<size_t>(info.st_size);
+	if (m_size == 0) {
+		::close(fd);
+		std::cerr << "Cannot map empty file: " << path << std::endl;
+		throw std::runtime_error("file map failed");
+	}
+
+	auto mapped = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED) {
+		m_size = 0;
+		std::cerr << "Could not map file: " << path << std::endl;
+		throw std::runtime_error("file map failed");
+	}
+
+	m_data = static_cast<const u8*>(mapped);
+}
+
+MappedFile::~MappedFile() {
+	release();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : m_data(other.m_data), m_size(other.m_size) {
+	other.m_data = nullptr;
+	other.m_size = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		release();
+		m_data = other.m_data;
+		m_size = other.m_size;
+		other.m_data = nullptr;
+		other.m_size = 0;
+	}
+	return *this;
+}
+
+MappedFile MappedFile::openIfExists(const std::string& path) {
+	if (::access(path.c_str(), R_OK) != 0) {
+		return {};
+	}
+	return MappedFile(path);
+}
+
+void MappedFile::prefetch(const u8* begin, size_t size) const {
+	if (size == 0) {
+		return;
+	}
+
+	auto pageSize = uintptr_t(::sysconf(_SC_PAGESIZE));
+	auto first = uintptr_t(begin) / pageSize * pageSize;
+	auto end = uintptr_t(begin) + size;
+	// readahead the whole range at once, then fault every page so none is missing when the range is used
+	::madvise(reinterpret_cast<void*>(first), end - first, MADV_WILLNEED);
+	volatile u8 sink = 0;
+	for (auto page = first; page < end; page += pageSize) {
+		sink = sink + *reinterpret_cast<const volatile u8*>(std::max(page, uintptr_t(begin)));
+	}
+}
+
+void MappedFile::evict(const u8* begin, size_t size) const {
+	auto pageSize = uintptr_t(::sysconf(_SC_PAGESIZE));
+	auto first = (uintptr_t(begin) + pageSize - 1) / pageSize * pageSize;
+	auto end = (uintptr_t(begin) + size) / pageSize * pageSize;
+	if (first < end) {
+		::madvise(reinterpret_cast<void*>(first), end - first, MADV_DONTNEED);
+	}
+}
+
+void MappedFile::release() {
+	if (m_data) {
+		::munmap(const_cast<u8*>(m_data), m_size);
+		m_data = nullptr;
+		m_size = 0;
+	}
+}
+
+u64 contentHash(const u8* data, size_t size, u64 seed) {
+	constexpr u64 MULTIPLIER = 0x9E3779B97F4A7C15ull;
+
+	auto mix = [](u64 h) {
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		return h;
+	};
+
+	u64 h = seed ^ (size * MULTIPLIER);
+	size_t i = 0;
+	for (; i + sizeof(u64) <= size; i += sizeof(u64)) {
+		u64 word;
+		std::memcpy(&word, data + i, sizeof(word));
+		h = (h ^ mix(word)) * MULTIPLIER;
+	}
+
+	u64 tail = 0;
+	std::memcpy(&tail, data + i, size - i);
+	h = (h ^ mix(tail)) * MULTIPLIER;
+	return mix(h);
+}
+
+void writeFileAtomically(const std::string& path, const std::vector<u8>& contents) {
+	auto tempPath = path + ".tmp" + std::to_string(::getpid());
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(contents.data()), contents.size());
+		if (!out) {
+			std::cerr << "Could not write file: " << tempPath << std::endl;
+			throw std::runtime_error("file write failed");
+		}
+	}
+
+	if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+		std::remove(tempPath.c_str());
+		std::cerr << "Could not move " << tempPath << " to " << path << std::endl;
+		throw std::runtime_error("file write failed");
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "predef.h"
+
+#include <string>
+
+#include "TypeUtil.h"
+
+// Read-only mapping of an entire file. Pages are faulted in straight from the page cache on first access,
+// so data read through it is never copied into process-owned buffers.
+class MappedFile {
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const u8* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool isOpen() const { return m_data != nullptr; }
+
+	// Returns an empty mapping instead of throwing when the file does not exist
+	static MappedFile openIfExists(const std::string& path);
+
+	// Reads the pages overlapping [begin, begin + size) in, blocking until they are all resident
+	void prefetch(const u8* begin, size_t size) const;
+	// Drops the pages lying entirely within [begin, begin + size) from memory, they are read back from the file on
+	// their next access
+	void evict(const u8* begin, size_t size) const;
+
+private:
+	void release();
+
+	const u8* m_data = nullptr;
+	size_t m_size = 0;
+};
+
+// Fast non-cryptographic 64 bit hash, used to detect when cached data is stale relative to its source
+u64 contentHash(const u8* data, size_t size, u64 seed = 0);
+
+// Writes the file under a temporary name and renames it into place, so readers never observe a partial file
+void writeFileAtomically(const std::string& path, const std::vector<u8>& contents);
+
@@ -0,0 +1,210 @@
+#include "mesh_optimizer.h"
+
+#include <list>
+
+namespace {
+
+constexpr float CACHE_DECAY_POWER = 1.5f;
+constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+constexpr float VALENCE_BOOST_SCALE = 2.0f;
+constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+constexpr u32 CACHE_LINE_SIZE = 64;
+constexpr u32 FETCH_CACHE_LINES = 64;
+
+float vertexScore(i32 cachePosition, u32 remainingTriangles) {
+	if (remainingTriangles == 0) {
+		return -1.0f;
+	}
+
+	float ret = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			// the vertices of the last triangle get a fixed score, so the next triangle does not simply reuse them
+			ret = LAST_TRIANGLE_SCORE;
+		} else {
+			auto scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+			ret = std::pow(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+		}
+	}
+
+	// vertices with few triangles left are finished off first, so they do not linger around
+	return ret + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+}
+
+}
+
+void optimizeVertexCache(Span<std::array<u32, 3>> indices, u32 vertexCount) {
+	auto triangleCount = u32(indices.size());
+	if (triangleCount == 0) {
+		return;
+	}
+
+	std::vector<u32> adjacencyOffsets(vertexCount + 1, 0);
+	for (const auto& tri : indices) {
+		for (auto v : tri) {
+			adjacencyOffsets[v + 1]++;
+		}
+	}
+	for (u32 v = 0; v < vertexCount; ++v) {
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+	std::vector<u32> adjacency(adjacencyOffsets[vertexCount]);
+	std::vector<u32> remaining(vertexCount, 0);
+	for (u32 t = 0; t < triangleCount; ++t) {
+		for (auto v : indices[t]) {
+			adjacency[adjacencyOffsets[v] + remaining[v]++] = t;
+		}
+	}
+
+	std::vector<i32> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (u32 v = 0; v < vertexCount; ++v) {
+		vertexScores[v] = vertexScore(-1, remaining[v]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (u32 t = 0; t < triangleCount; ++t) {
+		const auto& tri = indices[t];
+		triangleScores[t] = vertexScores[tri[0]] + vertexScores[tri[1]] + vertexScores[tri[2]];
+	}
+
+	std::vector<std::array<u32, 3>> ordered;
+	ordered.reserve(triangleCount);
+	std::vector<u32> cache;
+	cache.reserve(VERTEX_CACHE_SIZE + 3);
+	u32 scanCursor = 0;
+	i64 bestTriangle = -1;
+
+	while (ordered.size() < triangleCount) {
+		if (bestTriangle < 0) {
+			// nothing adjacent to the cache is left, fall back to the next unemitted triangle
+			while (emitted[scanCursor]) {
+				++scanCursor;
+			}
+			bestTriangle = scanCursor;
+		}
+
+		auto tri = indices[bestTriangle];
+		emitted[bestTriangle] = true;
+		ordered.push_back(tri);
+
+		for (auto v : tri) {
+			auto begin = adjacency.begin() + adjacencyOffsets[v];
+			auto end = begin + remaining[v];
+			std::iter_swap(std::find(begin, end, u32(bestTriangle)), end - 1);
+			remaining[v]--;
+
+			auto cached = std::find(cache.begin(), cache.end(), v);
+			if (cached != cache.end()) {
+				cache.erase(cached);
+			}
+		}
+		cache.insert(cache.begin(), tri.begin(), tri.end());
+
+		// vertices pushed out of the cache lose their cache score as well
+		for (size_t i = 0; i < cache.size(); ++i) {
+			cachePositions[cache[i]] = i < VERTEX_CACHE_SIZE ? i32(i) : -1;
+		}
+
+		for (auto v : cache) {
+			auto newScore = vertexScore(cachePositions[v], remaining[v]);
+			auto delta = newScore - vertexScores[v];
+			vertexScores[v] = newScore;
+			for (u32 i = 0; i < remaining[v]; ++i) {
+				triangleScores[adjacency[adjacencyOffsets[v] + i]] += delta;
+			}
+		}
+
+		if (cache.size() > VERTEX_CACHE_SIZE) {
+			cache.resize(VERTEX_CACHE_SIZE);
+		}
+
+		bestTriangle = -1;
+		auto bestScore = 0.0f;
+		for (auto v : cache) {
+			for (u32 i = 0; i < remaining[v]; ++i) {
+				auto t = adjacency[adjacencyOffsets[v] + i];
+				if (triangleScores[t] > bestScore) {
+					bestScore = triangleScores[t];
+					bestTriangle = t;
+				}
+			}
+		}
+	}
+
+	std::copy(ordered.begin(), ordered.end(), indices.begin());
+}
+
+std::vector<u32> optimizeVertexFetch(Span<std::array<u32, 3>> indices, u32 vertexCount) {
+	constexpr u32 UNASSIGNED = ~0u;
+
+	std::vector<u32> remap(vertexCount, UNASSIGNED);
+	u32 next = 0;
+	for (auto& tri : indices) {
+		for (auto& v : tri) {
+			if (remap[v] == UNASSIGNED) {
+				remap[v] = next++;
+			}
+			v = remap[v];
+		}
+	}
+
+	// vertices no triangle references keep their relative order behind the referenced ones
+	for (auto& newIndex : remap) {
+		if (newIndex == UNASSIGNED) {
+			newIndex = next++;
+		}
+	}
+
+	return remap;
+}
+
+float averageCacheMissRatio(Span<const std::array<u32, 3>> indices, u32 vertexCount, u32 cacheSize) {
+	if (indices.empty()) {
+		return 0.0f;
+	}
+
+	// a vertex is still cached while fewer than cacheSize misses happened since it was last loaded
+	std::vector<u64> loadedAt(vertexCount, 0);
+	u64 misses = 0;
+	for (const auto& tri : indices) {
+		for (auto v : tri) {
+			if (loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize) {
+				misses++;
+				loadedAt[v] = misses;
+			}
+		}
+	}
+
+	return static_cast<float>(misses) / indices.size();
+}
+
+float vertexFetchOverfetch(Span<const std::array<u32, 3>> indices, u32 vertexCount, u32 vertexSize) {
+	std::vector<bool> referenced(vertexCount, false);
+	std::list<u64> lines;
+	u64 fetchedLines = 0;
+	for (const auto& tri : indices) {
+		for (auto v : tri) {
+			referenced[v] = true;
+			auto first = u64(v) * vertexSize / CACHE_LINE_SIZE;
+			auto last = (u64(v) * vertexSize + vertexSize - 1) / CACHE_LINE_SIZE;
+			for (auto line = first; line <= last; ++line) {
+				auto found = std::find(lines.begin(), lines.end(), line);
+				if (found != lines.end()) {
+					lines.erase(found);
+				} else {
+					fetchedLines++;
+					if (lines.size() == FETCH_CACHE_LINES) {
+						lines.pop_back();
+					}
+				}
+				lines.push_front(line);
+			}
+		}
+	}
+
+	auto referencedBytes = u64(std::count(referenced.begin(), referenced.end(), true)) * vertexSize;
+	return referencedBytes == 0 ? 0.0f : static_cast<float>(fetchedLines * CACHE_LINE_SIZE) / referencedBytes;
+}
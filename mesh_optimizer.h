@@ -0,0 +1,24 @@
+#pragma once
+
+#include "predef.h"
+
+#include "TypeUtil.h"
+
+// Size of the FIFO vertex cache the reordering and the statistics are tuned for
+constexpr u32 VERTEX_CACHE_SIZE = 32;
+
+// Reorders triangles so consecutive triangles reuse recently referenced vertices, using Tom Forsyth's
+// "Linear-Speed Vertex Cache Optimisation". Vertex indices are left untouched.
+void optimizeVertexCache(Span<std::array<u32, 3>> indices, u32 vertexCount);
+
+// Renumbers vertices in the order the triangles first reference them and rewrites the indices to match.
+// Returns the new position of every old vertex, so the caller can reorder its vertex streams.
+std::vector<u32> optimizeVertexFetch(Span<std::array<u32, 3>> indices, u32 vertexCount);
+
+// Average number of vertex transforms per triangle with a FIFO post-transform cache (0.5 is ideal, 3 is worst)
+float averageCacheMissRatio(Span<const std::array<u32, 3>> indices, u32 vertexCount, u32 cacheSize = VERTEX_CACHE_SIZE);
+
+// Bytes pulled through 64 byte cache lines of a small LRU cache per byte of vertex data actually referenced,
+// 1 means every fetched line is fully used
+float vertexFetchOverfetch(Span<const std::array<u32, 3>> indices, u32 vertexCount, u32 vertexSize);
+
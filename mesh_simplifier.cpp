@@ -0,0 +1,240 @@
+#include "mesh_simplifier.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Area weighted sum of squared distances to a set of planes, as a symmetric 4x4 matrix
+struct Quadric {
+	double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+	double a11 = 0, a12 = 0, a13 = 0;
+	double a22 = 0, a23 = 0;
+	double a33 = 0;
+	double weight = 0;
+
+	Quadric& operator+=(const Quadric& other) {
+		a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+		a11 += other.a11; a12 += other.a12; a13 += other.a13;
+		a22 += other.a22; a23 += other.a23;
+		a33 += other.a33;
+		weight += other.weight;
+		return *this;
+	}
+};
+
+Quadric planeQuadric(double x, double y, double z, double d, double weight) {
+	Quadric ret;
+	ret.a00 = weight * x * x; ret.a01 = weight * x * y; ret.a02 = weight * x * z; ret.a03 = weight * x * d;
+	ret.a11 = weight * y * y; ret.a12 = weight * y * z; ret.a13 = weight * y * d;
+	ret.a22 = weight * z * z; ret.a23 = weight * z * d;
+	ret.a33 = weight * d * d;
+	ret.weight = weight;
+	return ret;
+}
+
+// Mean squared distance of the point to the planes
+double evaluate(const Quadric& q, const vec3& p) {
+	if (q.weight <= 0) {
+		return 0;
+	}
+
+	double x = p.x, y = p.y, z = p.z;
+	auto sum = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+		+ 2 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+		+ 2 * (q.a03 * x + q.a13 * y + q.a23 * z)
+		+ q.a33;
+	return std::max(sum, 0.0) / q.weight;
+}
+
+u64 edgeKey(u32 a, u32 b) {
+	return a < b ? (u64(a) << 32) | b : (u64(b) << 32) | a;
+}
+
+struct Collapse {
+	u32 from;
+	u32 to;
+	double cost;
+};
+
+// Vertex to triangle adjacency in compressed rows
+struct Adjacency {
+	Adjacency(const std::vector<std::array<u32, 3>>& triangles, u32 vertexCount)
+		: offsets(vertexCount + 1, 0), triangles(triangles.size() * 3) {
+		for (const auto& tri : triangles) {
+			for (auto v : tri) {
+				offsets[v + 1]++;
+			}
+		}
+		for (u32 v = 0; v < vertexCount; ++v) {
+			offsets[v + 1] += offsets[v];
+		}
+		std::vector<u32> filled(offsets.begin(), offsets.end() - 1);
+		for (u32 t = 0; t < triangles.size(); ++t) {
+			for (auto v : triangles[t]) {
+				this->triangles[filled[v]++] = t;
+			}
+		}
+	}
+
+	Span<const u32> of(u32 v) const {
+		return {triangles.data() + offsets[v], offsets[v + 1] - offsets[v]};
+	}
+
+	std::vector<u32> offsets;
+	std::vector<u32> triangles;
+};
+
+// True if moving from onto to turns any remaining triangle around from upside down
+bool flipsTriangles(
+	const std::vector<std::array<u32, 3>>& triangles, const Adjacency& adjacency,
+	Span<const vec3> positions, u32 from, u32 to) {
+	for (auto t : adjacency.of(from)) {
+		const auto& tri = triangles[t];
+		if (tri[0] == to || tri[1] == to || tri[2] == to) {
+			continue;
+		}
+
+		std::array<vec3, 3> corners;
+		for (size_t i = 0; i < 3; ++i) {
+			corners[i] = positions[tri[i]];
+		}
+		auto before = cross(corners[1] - corners[0], corners[2] - corners[0]);
+		for (size_t i = 0; i < 3; ++i) {
+			if (tri[i] == from) {
+				corners[i] = positions[to];
+			}
+		}
+		auto after = cross(corners[1] - corners[0], corners[2] - corners[0]);
+
+		if (dot(before, after) <= 0.0f) {
+			return true;
+		}
+	}
+	return false;
+}
+
+}
+
+std::vector<std::array<u32, 3>> simplifyMesh(
+	Span<const std::array<u32, 3>> indices,
+	Span<const vec3> positions,
+	u32 targetTriangleCount,
+	float& error) {
+	auto vertexCount = u32(positions.size());
+	std::vector<std::array<u32, 3>> triangles(indices.begin(), indices.end());
+	double maxCost = 0;
+
+	std::vector<Quadric> quadrics(vertexCount);
+	for (const auto& tri : triangles) {
+		auto normal = cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+		auto area = glm::length(normal);
+		if (area == 0.0f) {
+			continue;
+		}
+		normal /= area;
+		auto plane = planeQuadric(normal.x, normal.y, normal.z, -dot(normal, positions[tri[0]]), area);
+		for (auto v : tri) {
+			quadrics[v] += plane;
+		}
+	}
+
+	std::vector<u64> edges;
+	std::vector<bool> locked(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<u32> remap(vertexCount);
+	std::vector<Collapse> collapses;
+
+	while (triangles.size() > targetTriangleCount) {
+		// an edge used by one triangle lies on a border, one used by more than two is non-manifold
+		edges.clear();
+		for (const auto& tri : triangles) {
+			for (size_t i = 0; i < 3; ++i) {
+				edges.push_back(edgeKey(tri[i], tri[(i + 1) % 3]));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+
+		std::fill(locked.begin(), locked.end(), false);
+		collapses.clear();
+		for (size_t first = 0, last = 0; first < edges.size(); first = last) {
+			while (last < edges.size() && edges[last] == edges[first]) {
+				++last;
+			}
+			if (last - first != 2) {
+				locked[u32(edges[first] >> 32)] = true;
+				locked[u32(edges[first])] = true;
+			}
+		}
+
+		for (size_t first = 0, last = 0; first < edges.size(); first = last) {
+			while (last < edges.size() && edges[last] == edges[first]) {
+				++last;
+			}
+			auto a = u32(edges[first] >> 32);
+			auto b = u32(edges[first]);
+			if (last - first != 2 || (locked[a] && locked[b])) {
+				continue;
+			}
+
+			auto combined = quadrics[a];
+			combined += quadrics[b];
+			auto toB = locked[a] ? -1.0 : evaluate(combined, positions[b]);
+			auto toA = locked[b] ? -1.0 : evaluate(combined, positions[a]);
+			if (toA < 0 || (toB >= 0 && toB <= toA)) {
+				collapses.push_back({a, b, toB});
+			} else {
+				collapses.push_back({b, a, toA});
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs) {
+			return lhs.cost < rhs.cost;
+		});
+
+		Adjacency adjacency(triangles, vertexCount);
+		for (u32 v = 0; v < vertexCount; ++v) {
+			remap[v] = v;
+		}
+		std::fill(touched.begin(), touched.end(), false);
+
+		size_t removed = 0;
+		auto wanted = triangles.size() - targetTriangleCount;
+		for (const auto& collapse : collapses) {
+			if (removed >= wanted) {
+				break;
+			}
+			if (touched[collapse.from] || touched[collapse.to]
+				|| flipsTriangles(triangles, adjacency, positions, collapse.from, collapse.to)) {
+				continue;
+			}
+
+			// every triangle around from changes shape, so none of their vertices may move again this pass
+			for (auto t : adjacency.of(collapse.from)) {
+				const auto& tri = triangles[t];
+				for (auto v : tri) {
+					touched[v] = true;
+				}
+				removed += tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to;
+			}
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to] += quadrics[collapse.from];
+			maxCost = std::max(maxCost, collapse.cost);
+		}
+
+		if (removed == 0) {
+			break;
+		}
+
+		auto kept = triangles.begin();
+		for (const auto& tri : triangles) {
+			std::array<u32, 3> collapsed{remap[tri[0]], remap[tri[1]], remap[tri[2]]};
+			if (collapsed[0] != collapsed[1] && collapsed[1] != collapsed[2] && collapsed[0] != collapsed[2]) {
+				*kept++ = collapsed;
+			}
+		}
+		triangles.erase(kept, triangles.end());
+	}
+
+	error = float(std::sqrt(maxCost));
+	return triangles;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "predef.h"
+
+#include "TypeUtil.h"
+
+// Simplifies a mesh by collapsing edges in order of their quadric error (Garland and Heckbert, "Surface
+// Simplification Using Quadric Error Metrics") until at most targetTriangleCount triangles are left or no collapse
+// keeps the surface intact. Vertices collapse onto other vertices, so the result indexes the same vertex streams.
+// Border vertices, including the ones along texture seams, never move, so the simplified mesh does not crack.
+// The root of the largest collapse cost, an area weighted mean of squared plane distances, is stored in error. It
+// estimates the RMS distance in model space a collapse moved the surface and does not bound the largest distance.
+std::vector<std::array<u32, 3>> simplifyMesh(
+	Span<const std::array<u32, 3>> indices,
+	Span<const vec3> positions,
+	u32 targetTriangleCount,
+	float& error);
@@ -0,0 +1,217 @@
+#include "meshlet.h"
+
+namespace {
+
+// Triangles whose normals spread wider than this are never culled by their cone, the test would be too loose
+constexpr float MIN_CONE_DOT = 0.1f;
+
+}
+
+Frustum::Frustum(const mat4& mvp) {
+	auto row = [&mvp](int i) {
+		return vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+	};
+
+	planes = {
+		row(3) + row(0), row(3) - row(0),
+		row(3) + row(1), row(3) - row(1),
+		row(3) + row(2), row(3) - row(2)
+	};
+	for (auto& plane : planes) {
+		plane /= glm::length(vec3(plane));
+	}
+}
+
+bool Frustum::intersects(const vec3& center, float radius) const {
+	for (const auto& plane : planes) {
+		if (dot(vec3(plane), center) + plane.w < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+BoundingSphere boundingSphere(Span<const vec3> points) {
+	if (points.empty()) {
+		return {vec3(0.0f), 0.0f};
+	}
+
+	auto lo = points[0];
+	auto hi = points[0];
+	for (const auto& p : points) {
+		lo = glm::min(lo, p);
+		hi = glm::max(hi, p);
+	}
+
+	auto center = (lo + hi) * 0.5f;
+	auto radius = 0.0f;
+	for (const auto& p : points) {
+		radius = std::max(radius, glm::length(p - center));
+	}
+
+	return {center, radius};
+}
+
+std::vector<u32> clusterTriangles(Span<std::array<u32, 3>> indices, u32 vertexCount) {
+	auto triangleCount = u32(indices.size());
+	std::vector<u32> adjacencyOffsets(vertexCount + 1, 0);
+	for (const auto& tri : indices) {
+		for (auto v : tri) {
+			adjacencyOffsets[v + 1]++;
+		}
+	}
+	for (u32 v = 0; v < vertexCount; ++v) {
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+	std::vector<u32> adjacency(adjacencyOffsets[vertexCount]);
+	std::vector<u32> filled(vertexCount, 0);
+	for (u32 t = 0; t < triangleCount; ++t) {
+		for (auto v : indices[t]) {
+			adjacency[adjacencyOffsets[v] + filled[v]++] = t;
+		}
+	}
+
+	constexpr u32 NO_MESHLET = ~0u;
+	std::vector<u32> vertexMeshlet(vertexCount, NO_MESHLET);
+	std::vector<bool> used(triangleCount, false);
+	std::vector<std::array<u32, 3>> ordered;
+	ordered.reserve(triangleCount);
+	std::vector<u32> meshletSizes;
+	std::vector<u32> meshletVertecies;
+	u32 scanCursor = 0;
+
+	auto newVertecies = [&](u32 t) {
+		u32 ret = 0;
+		for (auto v : indices[t]) {
+			ret += vertexMeshlet[v] != u32(meshletSizes.size());
+		}
+		return ret;
+	};
+
+	while (ordered.size() < triangleCount) {
+		meshletSizes.push_back(0);
+		meshletVertecies.clear();
+		auto meshletId = u32(meshletSizes.size() - 1);
+
+		while (meshletSizes.back() < MESHLET_MAX_TRIANGLES && ordered.size() < triangleCount) {
+			// prefer the triangle adding the fewest vertices, then the earliest one to keep the incoming order
+			u32 best = triangleCount;
+			u32 bestNew = 4;
+			for (auto v : meshletVertecies) {
+				for (auto i = adjacencyOffsets[v]; i < adjacencyOffsets[v + 1]; ++i) {
+					auto t = adjacency[i];
+					if (used[t]) {
+						continue;
+					}
+					auto added = newVertecies(t);
+					if (added < bestNew || (added == bestNew && t < best)) {
+						best = t;
+						bestNew = added;
+					}
+				}
+			}
+
+			if (best == triangleCount) {
+				while (used[scanCursor]) {
+					++scanCursor;
+				}
+				best = scanCursor;
+				bestNew = newVertecies(best);
+			}
+
+			if (meshletVertecies.size() + bestNew > MESHLET_MAX_VERTICES) {
+				break;
+			}
+
+			used[best] = true;
+			ordered.push_back(indices[best]);
+			meshletSizes.back()++;
+			for (auto v : indices[best]) {
+				if (vertexMeshlet[v] != meshletId) {
+					vertexMeshlet[v] = meshletId;
+					meshletVertecies.push_back(v);
+				}
+			}
+		}
+	}
+
+	std::copy(ordered.begin(), ordered.end(), indices.begin());
+	return meshletSizes;
+}
+
+Meshlet buildMeshlet(Span<const std::array<u32, 3>> meshIndices, u32 baseIndex, u32 indexCount, Span<const vec3> positions) {
+	auto triangles = meshIndices.subspan(baseIndex, indexCount);
+
+	std::vector<vec3> points;
+	std::vector<vec3> normals;
+	for (const auto& tri : triangles) {
+		for (auto v : tri) {
+			points.push_back(positions[v]);
+		}
+
+		auto normal = cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+		auto area = glm::length(normal);
+		if (area > 0.0f) {
+			normals.push_back(normal / area);
+		}
+	}
+
+	auto bounds = boundingSphere(points);
+	Meshlet ret{baseIndex, indexCount, bounds.center, bounds.radius, vec3(0.0f), 1.0f};
+
+	auto axis = vec3(0.0f);
+	for (const auto& normal : normals) {
+		axis += normal;
+	}
+	if (glm::length(axis) == 0.0f) {
+		return ret;
+	}
+	axis = glm::normalize(axis);
+
+	auto minDot = 1.0f;
+	for (const auto& normal : normals) {
+		minDot = std::min(minDot, dot(normal, axis));
+	}
+
+	// a cutoff of 1 never culls
+	if (minDot >= MIN_CONE_DOT) {
+		ret.coneAxis = axis;
+		ret.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+	}
+
+	return ret;
+}
+
+vec3 meshletOrderDirection(u32 direction) {
+	auto ret = vec3(0.0f);
+	ret[direction / 2] = direction % 2 == 0 ? 1.0f : -1.0f;
+	return ret;
+}
+
+u32 closestMeshletOrderDirection(const vec3& viewDirection) {
+	u32 ret = 0;
+	for (u32 direction = 1; direction < MESHLET_ORDER_DIRECTIONS; ++direction) {
+		if (dot(viewDirection, meshletOrderDirection(direction)) > dot(viewDirection, meshletOrderDirection(ret))) {
+			ret = direction;
+		}
+	}
+	return ret;
+}
+
+std::vector<u32> orderMeshlets(Span<const Meshlet> meshlets, const vec3& direction) {
+	std::vector<u32> ret(meshlets.size());
+	for (u32 i = 0; i < ret.size(); ++i) {
+		ret[i] = i;
+	}
+
+	// by the point of every bounding sphere nearest to a camera far back along the direction
+	std::stable_sort(ret.begin(), ret.end(), [&](u32 a, u32 b) {
+		return dot(meshlets[a].center, direction) - meshlets[a].radius < dot(meshlets[b].center, direction) - meshlets[b].radius;
+	});
+	return ret;
+}
+
+bool isBackfacing(const Meshlet& meshlet, const vec3& cameraPos) {
+	auto toCenter = meshlet.center - cameraPos;
+	return dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
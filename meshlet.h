@@ -0,0 +1,59 @@
+#pragma once
+
+#include "predef.h"
+
+#include "TypeUtil.h"
+
+constexpr u32 MESHLET_MAX_VERTICES = 64;
+constexpr u32 MESHLET_MAX_TRIANGLES = 124;
+
+// A small cluster of a mesh's triangles, culled as a whole before any of its vertices are transformed.
+// Its triangles are a contiguous range of the mesh's indices, relative to the owning mesh.
+struct Meshlet {
+	u32 baseIndex;
+	u32 indexCount;
+	vec3 center;
+	float radius;
+	// Every triangle faces away from cameras in the cone around -coneAxis, see isBackfacing
+	vec3 coneAxis;
+	float coneCutoff;
+};
+
+struct BoundingSphere {
+	vec3 center;
+	float radius;
+};
+
+// Clip space frustum planes, extracted from the view projection matrix
+struct Frustum {
+	explicit Frustum(const mat4& mvp);
+
+	bool intersects(const vec3& center, float radius) const;
+
+	std::array<vec4, 6> planes;
+};
+
+// Sphere around the axis aligned bounds of the points
+BoundingSphere boundingSphere(Span<const vec3> points);
+
+// Groups the triangles into meshlets, growing each one through the triangles that share its vertices, and reorders
+// the triangles so every meshlet is a contiguous range. Returns the triangle count of each meshlet in order.
+std::vector<u32> clusterTriangles(Span<std::array<u32, 3>> indices, u32 vertexCount);
+
+// Computes the bounding sphere and normal cone of the meshlet made of the given triangles
+Meshlet buildMeshlet(Span<const std::array<u32, 3>> meshIndices, u32 baseIndex, u32 indexCount, Span<const vec3> positions);
+
+// Number of view directions, the positive and negative axes, that meshlet draw orders are precomputed for
+constexpr u32 MESHLET_ORDER_DIRECTIONS = 6;
+
+vec3 meshletOrderDirection(u32 direction);
+
+// The precomputed direction closest to the view direction
+u32 closestMeshletOrderDirection(const vec3& viewDirection);
+
+// Indices of the meshlets ordered front to back for a camera looking along the direction
+std::vector<u32> orderMeshlets(Span<const Meshlet> meshlets, const vec3& direction);
+
+// True when the camera sees only the back faces of the meshlet, no matter where within the bounds they are
+bool isBackfacing(const Meshlet& meshlet, const vec3& cameraPos);
+
@@ -0,0 +1,274 @@
+#include "predef.h"
+
+#include <random>
+#include <string>
+
+#include "block_compression.h"
+#include "clipping.h"
+#include "converters.h"
+#include "rasterizer.h"
+#include "texture.h"
+
+// Microbenchmarks of the pipeline's hot kernels on synthetic, seeded input, so a kernel can be tuned and measured
+// in isolation without a window or a scene.
+// Usage: microbench [filter], runs the benchmarks whose name contains the filter and prints their time per item.
+
+namespace {
+
+const uvec2 VIEWPORT{1280, 720};
+const float NEAR_PLANE = 0.125f;
+const float FAR_PLANE = 5000.0f;
+const float FOV = glm::radians(60.0f);
+
+constexpr size_t TRIANGLE_COUNT = 4096;
+// The edge loop visits every pixel of the viewport per triangle, so few triangles make for a long run
+constexpr size_t EDGE_LOOP_TRIANGLES = 4;
+constexpr u32 TEXTURE_SIZE = 1024;
+constexpr size_t SAMPLE_COUNT = 1 << 16;
+// Every benchmark repeats its body for at least MIN_RUN_TIME and reports the fastest of REPETITIONS such runs
+constexpr auto MIN_RUN_TIME = std::chrono::milliseconds(100);
+constexpr int REPETITIONS = 5;
+
+// Keeps the compiler from dropping a computation whose result is never read
+template <typename T>
+void keep(const T& value) {
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Runs body, which handles itemCount items per call, and prints the time per item
+template <typename Body>
+void run(const std::string& filter, const std::string& name, size_t itemCount, Body body) {
+	if (name.find(filter) == std::string::npos) {
+		return;
+	}
+
+	auto best = std::numeric_limits<double>::max();
+	for (auto repetition = 0; repetition < REPETITIONS; ++repetition) {
+		size_t calls = 0;
+		auto start = std::chrono::steady_clock::now();
+		std::chrono::steady_clock::duration elapsed;
+		do {
+			body();
+			++calls;
+			elapsed = std::chrono::steady_clock::now() - start;
+		} while (elapsed < MIN_RUN_TIME);
+		best = std::min(best, std::chrono::duration<double, std::nano>(elapsed).count() / (calls * itemCount));
+	}
+
+	std::cout << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(3)
+		<< std::setw(14) << best << " ns/item" << std::endl;
+}
+
+struct ConstantShader : MiniFragmentShader<vec2, ConstantShader> {
+	vec4 shade(vec2 data) {
+		return {data, 0.5f, 1.0f};
+	}
+};
+
+// Triangles of one synthetic distribution, in clip space, and what the rasterizer makes of them
+struct TriangleSet {
+	std::string name;
+	std::vector<Triangle> triangles;
+	// the fan pieces of the clipped triangles
+	std::vector<std::array<vec4, 3>> pieces;
+	std::vector<detail::TriangleRecord> records;
+};
+
+// Splits the triangle into its clipped fan pieces the way the rasterizer does
+std::vector<std::array<vec4, 3>> clipPieces(const Triangle& triangle) {
+	std::array<vec2, 9> coeffs;
+	auto vertexCount = clip(triangle, coeffs);
+	auto at = [&](const vec2& c) {
+		return triangle.v0 + (triangle.v1 - triangle.v0) * c.x + (triangle.v2 - triangle.v0) * c.y;
+	};
+
+	std::vector<std::array<vec4, 3>> ret;
+	for (size_t i = 2; i < vertexCount; ++i) {
+		ret.push_back({at(coeffs[0]), at(coeffs[i - 1]), at(coeffs[i])});
+	}
+	return ret;
+}
+
+// Projects view space triangles made by makeTriangle, flipping them to face the camera
+template <typename MakeTriangle>
+TriangleSet makeTriangleSet(const std::string& name, MakeTriangle makeTriangle) {
+	auto proj = glm::perspective(FOV, float(VIEWPORT.x) / VIEWPORT.y, NEAR_PLANE, FAR_PLANE);
+	std::mt19937 rng(1);
+
+	TriangleSet ret;
+	ret.name = name;
+	while (ret.triangles.size() < TRIANGLE_COUNT) {
+		std::array<vec3, 3> view = makeTriangle(rng);
+		Triangle triangle{proj * vec4(view[0], 1), proj * vec4(view[1], 1), proj * vec4(view[2], 1)};
+		auto pieces = clipPieces(triangle);
+		if (pieces.empty()) {
+			continue;
+		}
+		if (detail::TriangleRecord(pieces[0][0], pieces[0][1], pieces[0][2], VIEWPORT).area >= 0) {
+			std::swap(triangle.v1, triangle.v2);
+			pieces = clipPieces(triangle);
+		}
+
+		ret.triangles.push_back(triangle);
+		for (const auto& piece : pieces) {
+			ret.pieces.push_back(piece);
+			detail::TriangleRecord record(piece[0], piece[1], piece[2], VIEWPORT);
+			if (record.area < 0) {
+				ret.records.push_back(record);
+			}
+		}
+	}
+	return ret;
+}
+
+// View space point at the NDC position and distance from the camera
+vec3 unproject(float ndcX, float ndcY, float distance) {
+	auto halfHeight = distance * std::tan(FOV / 2);
+	return {ndcX * halfHeight * VIEWPORT.x / VIEWPORT.y, ndcY * halfHeight, -distance};
+}
+
+std::vector<TriangleSet> makeTriangleSets() {
+	using Rng = std::mt19937;
+	auto uniform = [](Rng& rng, float min, float max) {
+		return std::uniform_real_distribution<float>(min, max)(rng);
+	};
+
+	std::vector<TriangleSet> ret;
+	// a few pixels across, anywhere on screen
+	ret.push_back(makeTriangleSet("tiny", [&](Rng& rng) {
+		auto distance = uniform(rng, 2, 50);
+		auto center = unproject(uniform(rng, -0.9f, 0.9f), uniform(rng, -0.9f, 0.9f), distance);
+		auto pixel = 2 * distance * std::tan(FOV / 2) / VIEWPORT.y;
+		auto corner = [&] { return center + vec3(uniform(rng, -2, 2), uniform(rng, -2, 2), 0) * pixel; };
+		return std::array<vec3, 3>{corner(), corner(), corner()};
+	}));
+	// covering about half the screen
+	ret.push_back(makeTriangleSet("huge", [&](Rng& rng) {
+		auto distance = uniform(rng, 2, 50);
+		return std::array<vec3, 3>{
+			unproject(uniform(rng, -0.95f, -0.8f), uniform(rng, -0.95f, -0.8f), distance),
+			unproject(uniform(rng, 0.8f, 0.95f), uniform(rng, -0.95f, -0.8f), distance),
+			unproject(uniform(rng, -0.1f, 0.1f), uniform(rng, 0.8f, 0.95f), distance)};
+	}));
+	// one corner behind the camera, so every triangle is cut by the near plane
+	ret.push_back(makeTriangleSet("near", [&](Rng& rng) {
+		return std::array<vec3, 3>{
+			unproject(uniform(rng, -0.5f, 0.5f), uniform(rng, -0.5f, 0.5f), uniform(rng, 1, 10)),
+			unproject(uniform(rng, -0.5f, 0.5f), uniform(rng, -0.5f, 0.5f), uniform(rng, 1, 10)),
+			vec3(uniform(rng, -1, 1), uniform(rng, -1, 1), uniform(rng, 0.5f, 2))};
+	}));
+	return ret;
+}
+
+Texture makeTexture(TextureFormat format) {
+	std::mt19937 rng(1);
+	std::vector<u8> rgba(size_t(TEXTURE_SIZE) * TEXTURE_SIZE * 4);
+	for (auto& channel : rgba) {
+		channel = u8(rng());
+	}
+
+	Texture ret;
+	ret.format = format;
+	if (format == TextureFormat::RGBA8) {
+		ret.ownedTexels = std::move(rgba);
+	} else {
+		ret.ownedTexels.resize(levelBytes(format, TEXTURE_SIZE, TEXTURE_SIZE));
+		compressImage(format, rgba.data(), TEXTURE_SIZE, TEXTURE_SIZE, ret.ownedTexels.data());
+	}
+	ret.levels.push_back({ret.ownedTexels.data(), TEXTURE_SIZE, TEXTURE_SIZE});
+	return ret;
+}
+
+}
+
+int main(int argc, const char** argv) {
+	std::string filter = argc > 1 ? argv[1] : "";
+
+	auto triangleSets = makeTriangleSets();
+	std::vector<float> depthBuffer(VIEWPORT.x * VIEWPORT.y);
+	std::vector<Color> colorBuffer(VIEWPORT.x * VIEWPORT.y);
+	clearTargets(VIEWPORT, depthBuffer.data(), colorBuffer.data());
+
+	for (const auto& set : triangleSets) {
+		run(filter, "clip/" + set.name, set.triangles.size(), [&] {
+			std::array<vec2, 9> coeffs;
+			for (const auto& triangle : set.triangles) {
+				keep(clip(triangle, coeffs));
+				keep(coeffs);
+			}
+		});
+
+		run(filter, "clipAgainstPlane/" + set.name, set.triangles.size(), [&] {
+			std::array<vec2, 9> coeffs{vec2(0, 0), vec2(1, 0), vec2(0, 1)};
+			std::array<vec2, 9> clipped;
+			for (const auto& triangle : set.triangles) {
+				// the near plane, z >= -w
+				auto d1 = triangle.v1 - triangle.v0;
+				auto d2 = triangle.v2 - triangle.v0;
+				keep(clipAgainstPlane(clipped, coeffs, 3, triangle.v0.w + triangle.v0.z, d1.w + d1.z, d2.w + d2.z));
+				keep(clipped);
+			}
+		});
+
+		run(filter, "triangleRecord/" + set.name, set.pieces.size(), [&] {
+			for (const auto& piece : set.pieces) {
+				detail::TriangleRecord record(piece[0], piece[1], piece[2], VIEWPORT);
+				keep(record);
+			}
+		});
+
+		// per pixel tested, and over again the same pixels, which keep passing the depth test at equal depth
+		auto edgeLoopTriangles = std::min(EDGE_LOOP_TRIANGLES, set.records.size());
+		run(filter, "edgeLoop/" + set.name, edgeLoopTriangles * VIEWPORT.x * VIEWPORT.y, [&] {
+			ConstantShader shader;
+			const glm::mat<3, 2, float> texCoords{vec2(0, 0), vec2(1, 0), vec2(0, 1)};
+			PipelineStats stats;
+			for (size_t i = 0; i < edgeLoopTriangles; ++i) {
+				detail::rasterPixels(
+					VIEWPORT, set.records[i], texCoords, shader, depthBuffer.data(), colorBuffer.data(), stats);
+			}
+			keep(colorBuffer[0]);
+		});
+	}
+
+	const auto& vertexSet = triangleSets[0];
+	run(filter, "rasterFromNDC", vertexSet.pieces.size() * 3, [&] {
+		for (const auto& piece : vertexSet.pieces) {
+			for (const auto& vertex : piece) {
+				keep(detail::rasterFromNDC(vertex, VIEWPORT));
+			}
+		}
+	});
+
+	// coordinates of a 256x256 pixel patch mapped one texel per pixel, in the order the edge loop visits pixels
+	std::vector<vec2> texCoords;
+	for (size_t i = 0; i < SAMPLE_COUNT; ++i) {
+		texCoords.push_back(vec2(i % 256 + 0.5f, i / 256 + 0.5f) / float(TEXTURE_SIZE));
+	}
+	for (auto format : {TextureFormat::RGBA8, TextureFormat::BC1}) {
+		auto texture = makeTexture(format);
+		run(filter, format == TextureFormat::RGBA8 ? "shade/rgba8" : "shade/bc1", texCoords.size(), [&] {
+			Texture2DSamplerShader shader(texture);
+			for (const auto& texCoord : texCoords) {
+				keep(shader.shade(texCoord));
+			}
+		});
+	}
+
+	std::vector<vec4> colors;
+	std::mt19937 rng(1);
+	for (size_t i = 0; i < SAMPLE_COUNT; ++i) {
+		std::uniform_real_distribution<float> channel(0, 1);
+		colors.push_back({channel(rng), channel(rng), channel(rng), channel(rng)});
+	}
+	run(filter, "mkColor", colors.size(), [&] {
+		for (const auto& color : colors) {
+			keep(mkColor(color));
+		}
+	});
+
+	run(filter, "clearTargets", size_t(VIEWPORT.x) * VIEWPORT.y, [&] {
+		clearTargets(VIEWPORT, depthBuffer.data(), colorBuffer.data());
+		keep(depthBuffer[0]);
+	});
+}
@@ -0,0 +1,339 @@
+#include "obj_parser.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <thread>
+
+#include "parallel.h"
+
+namespace {
+
+// Smaller chunks cost more in scheduling than they gain in parallelism
+constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+// More chunks than threads even out chunks that happen to be slower to parse
+constexpr size_t CHUNKS_PER_THREAD = 4;
+
+struct Chunk {
+	const char* begin;
+	const char* end;
+};
+
+struct ElementCounts {
+	u32 positions = 0;
+	u32 texCoords = 0;
+	u32 triangles = 0;
+};
+
+enum class ObjEventKind {
+	Group,
+	Material,
+	MaterialLibrary
+};
+
+// Statement that does not produce geometry, placed by the number of triangles before it
+struct ObjEvent {
+	ObjEventKind kind;
+	u32 triangle;
+	std::string name;
+};
+
+bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+const char* skipBlanks(const char* cursor, const char* end) {
+	while (cursor < end && isBlank(*cursor)) {
+		++cursor;
+	}
+	return cursor;
+}
+
+const char* skipToken(const char* cursor, const char* end) {
+	while (cursor < end && !isBlank(*cursor)) {
+		++cursor;
+	}
+	return cursor;
+}
+
+const char* findLineEnd(const char* cursor, const char* end) {
+	auto found = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+	return found ? found : end;
+}
+
+// If the line starts with the keyword, returns where its arguments start
+const char* matchKeyword(const char* cursor, const char* end, const char* keyword) {
+	auto length = std::strlen(keyword);
+	if (size_t(end - cursor) < length || std::memcmp(cursor, keyword, length) != 0
+		|| (cursor + length < end && !isBlank(cursor[length]))) {
+		return nullptr;
+	}
+	return skipBlanks(cursor + length, end);
+}
+
+// The rest of the line without surrounding blanks
+std::string restOfLine(const char* cursor, const char* end) {
+	while (end > cursor && isBlank(end[-1])) {
+		--end;
+	}
+	return std::string(cursor, end);
+}
+
+[[noreturn]] void malformed(const char* lineBegin, const char* lineEnd) {
+	std::cerr << "Malformed OBJ line: " << restOfLine(lineBegin, lineEnd) << std::endl;
+	throw std::runtime_error("malformed obj");
+}
+
+// Splits the file into chunks that end right after a line break, or at the end of the file
+std::vector<Chunk> splitLines(const char* data, size_t size) {
+	size_t threads = std::max(1u, std::thread::hardware_concurrency());
+	auto chunkCount = std::max<size_t>(1, std::min(threads * CHUNKS_PER_THREAD, size / MIN_CHUNK_BYTES));
+
+	std::vector<Chunk> ret;
+	auto begin = data;
+	auto end = data + size;
+	for (size_t i = 1; i < chunkCount; ++i) {
+		auto split = data + size * i / chunkCount;
+		if (split < begin) {
+			continue;
+		}
+		split = findLineEnd(split, end);
+		split = split < end ? split + 1 : end;
+		ret.push_back({begin, split});
+		begin = split;
+	}
+	ret.push_back({begin, end});
+
+	return ret;
+}
+
+ElementCounts countElements(const Chunk& chunk) {
+	ElementCounts ret;
+	for (auto line = chunk.begin; line < chunk.end;) {
+		auto lineEnd = findLineEnd(line, chunk.end);
+		auto cursor = skipBlanks(line, lineEnd);
+		const char* args;
+		if ((args = matchKeyword(cursor, lineEnd, "v"))) {
+			ret.positions++;
+		} else if ((args = matchKeyword(cursor, lineEnd, "vt"))) {
+			ret.texCoords++;
+		} else if ((args = matchKeyword(cursor, lineEnd, "f"))) {
+			u32 corners = 0;
+			for (args = skipBlanks(args, lineEnd); args < lineEnd; args = skipBlanks(skipToken(args, lineEnd), lineEnd)) {
+				corners++;
+			}
+			if (corners < 3) {
+				malformed(line, lineEnd);
+			}
+			ret.triangles += corners - 2;
+		}
+		line = lineEnd + 1;
+	}
+	return ret;
+}
+
+// Parses the floats of a v or vt statement, at least minCount and at most out.size()
+template <size_t N>
+void parseFloats(const char* line, const char* args, const char* lineEnd, size_t minCount, std::array<float, N>& out) {
+	size_t count = 0;
+	for (auto cursor = args; cursor < lineEnd && count < N; cursor = skipBlanks(cursor, lineEnd)) {
+		auto result = std::from_chars(cursor, lineEnd, out[count++]);
+		if (result.ec != std::errc()) {
+			malformed(line, lineEnd);
+		}
+		cursor = result.ptr;
+	}
+	if (count < minCount) {
+		malformed(line, lineEnd);
+	}
+}
+
+// Resolves a one based, or negative relative, OBJ index into a zero based one
+u32 resolveIndex(long index, u32 defined, u32 total, const char* line, const char* lineEnd) {
+	long resolved = index > 0 ? index - 1 : long(defined) + index;
+	if (index == 0 || resolved < 0 || resolved >= long(total)) {
+		malformed(line, lineEnd);
+	}
+	return u32(resolved);
+}
+
+ObjCorner parseCorner(
+	const char* token, const char* tokenEnd,
+	const ElementCounts& defined, const ElementCounts& totals,
+	const char* line, const char* lineEnd) {
+	long position;
+	auto result = std::from_chars(token, tokenEnd, position);
+	if (result.ec != std::errc() || result.ptr == tokenEnd || *result.ptr != '/') {
+		std::cerr << "Face corner without texture coordinate" << std::endl;
+		malformed(line, lineEnd);
+	}
+
+	long texCoord;
+	result = std::from_chars(result.ptr + 1, tokenEnd, texCoord);
+	if (result.ec != std::errc() || (result.ptr != tokenEnd && *result.ptr != '/')) {
+		std::cerr << "Face corner without texture coordinate" << std::endl;
+		malformed(line, lineEnd);
+	}
+
+	return {
+		resolveIndex(position, defined.positions, totals.positions, line, lineEnd),
+		resolveIndex(texCoord, defined.texCoords, totals.texCoords, line, lineEnd)};
+}
+
+// Parses the chunk's elements into the streams, starting at the given counts of elements before the chunk
+void parseChunk(
+	const Chunk& chunk, ElementCounts defined, const ElementCounts& totals,
+	ObjData& out, std::vector<ObjEvent>& events) {
+	for (auto line = chunk.begin; line < chunk.end;) {
+		auto lineEnd = findLineEnd(line, chunk.end);
+		auto cursor = skipBlanks(line, lineEnd);
+		const char* args;
+		if ((args = matchKeyword(cursor, lineEnd, "v"))) {
+			std::array<float, 3> coords;
+			parseFloats(line, args, lineEnd, 3, coords);
+			out.positions[defined.positions++] = vec3(coords[0], coords[1], coords[2]);
+		} else if ((args = matchKeyword(cursor, lineEnd, "vt"))) {
+			std::array<float, 2> coords;
+			parseFloats(line, args, lineEnd, 2, coords);
+			out.texCoords[defined.texCoords++] = vec2(coords[0], 1.0f - coords[1]);
+		} else if ((args = matchKeyword(cursor, lineEnd, "f"))) {
+			ObjCorner first{};
+			ObjCorner previous{};
+			u32 corners = 0;
+			for (auto token = args; token < lineEnd; token = skipBlanks(token, lineEnd)) {
+				auto tokenEnd = skipToken(token, lineEnd);
+				auto corner = parseCorner(token, tokenEnd, defined, totals, line, lineEnd);
+				if (corners == 0) {
+					first = corner;
+				} else if (corners >= 2) {
+					out.triangles[defined.triangles++] = {first, previous, corner};
+				}
+				previous = corner;
+				corners++;
+				token = tokenEnd;
+			}
+		} else if ((args = matchKeyword(cursor, lineEnd, "g")) || (args = matchKeyword(cursor, lineEnd, "o"))) {
+			events.push_back({ObjEventKind::Group, defined.triangles, restOfLine(args, lineEnd)});
+		} else if ((args = matchKeyword(cursor, lineEnd, "usemtl"))) {
+			events.push_back({ObjEventKind::Material, defined.triangles, restOfLine(args, lineEnd)});
+		} else if ((args = matchKeyword(cursor, lineEnd, "mtllib"))) {
+			for (auto token = args; token < lineEnd; token = skipBlanks(token, lineEnd)) {
+				auto tokenEnd = skipToken(token, lineEnd);
+				events.push_back({ObjEventKind::MaterialLibrary, defined.triangles, std::string(token, tokenEnd)});
+				token = tokenEnd;
+			}
+		}
+		line = lineEnd + 1;
+	}
+}
+
+// Skips the options of an MTL texture statement, returning where the file name starts. -o, -s and -t take up to
+// three numbers, the other options a fixed number of arguments.
+const char* skipTextureOptions(const char* cursor, const char* end) {
+	static const std::map<std::string, size_t> OPTION_ARGUMENTS = {
+		{"-blendu", 1}, {"-blendv", 1}, {"-boost", 1}, {"-cc", 1}, {"-clamp", 1}, {"-imfchan", 1}, {"-texres", 1},
+		{"-bm", 1}, {"-type", 1}, {"-mm", 2}, {"-o", 3}, {"-s", 3}, {"-t", 3}};
+	while (cursor < end && *cursor == '-') {
+		auto optionEnd = skipToken(cursor, end);
+		auto option = OPTION_ARGUMENTS.find(std::string(cursor, optionEnd));
+		if (option == OPTION_ARGUMENTS.end()) {
+			break;
+		}
+
+		auto vector = option->second == 3;
+		cursor = skipBlanks(optionEnd, end);
+		for (size_t i = 0; i < option->second && cursor < end; ++i) {
+			auto argumentEnd = skipToken(cursor, end);
+			float value;
+			// the components of a vector after the first are optional
+			if (vector && i > 0 && std::from_chars(cursor, argumentEnd, value).ptr != argumentEnd) {
+				break;
+			}
+			cursor = skipBlanks(argumentEnd, end);
+		}
+	}
+	return cursor;
+}
+
+}
+
+ObjData parseObj(const MappedFile& file) {
+	auto chunks = splitLines(reinterpret_cast<const char*>(file.data()), file.size());
+
+	std::vector<ElementCounts> counts(chunks.size());
+	parallelFor(chunks.size(), [&](size_t i) {
+		counts[i] = countElements(chunks[i]);
+	});
+
+	// elements defined before every chunk, which is where the chunk writes to and what relative indices refer to
+	std::vector<ElementCounts> bases(chunks.size());
+	ElementCounts totals;
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		bases[i] = totals;
+		totals.positions += counts[i].positions;
+		totals.texCoords += counts[i].texCoords;
+		totals.triangles += counts[i].triangles;
+	}
+
+	ObjData ret;
+	ret.positions.resize(totals.positions);
+	ret.texCoords.resize(totals.texCoords);
+	ret.triangles.resize(totals.triangles);
+
+	std::vector<std::vector<ObjEvent>> events(chunks.size());
+	parallelFor(chunks.size(), [&](size_t i) {
+		parseChunk(chunks[i], bases[i], totals, ret, events[i]);
+	});
+
+	std::string material;
+	u32 groupStart = 0;
+	auto closeGroup = [&](u32 end) {
+		if (end > groupStart) {
+			ret.groups.push_back({groupStart, end - groupStart, material});
+		}
+		groupStart = end;
+	};
+	for (const auto& chunkEvents : events) {
+		for (const auto& event : chunkEvents) {
+			if (event.kind == ObjEventKind::MaterialLibrary) {
+				ret.materialLibraries.push_back(event.name);
+				continue;
+			}
+			if (event.kind == ObjEventKind::Material && event.name == material) {
+				continue;
+			}
+
+			closeGroup(event.triangle);
+			if (event.kind == ObjEventKind::Material) {
+				material = event.name;
+			}
+		}
+	}
+	closeGroup(totals.triangles);
+
+	return ret;
+}
+
+std::map<std::string, std::string> parseMaterialTextures(const MappedFile& file) {
+	std::map<std::string, std::string> ret;
+	std::string material;
+	auto data = reinterpret_cast<const char*>(file.data());
+	auto end = data + file.size();
+	for (auto line = data; line < end;) {
+		auto lineEnd = findLineEnd(line, end);
+		auto cursor = skipBlanks(line, lineEnd);
+		const char* args;
+		if ((args = matchKeyword(cursor, lineEnd, "newmtl"))) {
+			material = restOfLine(args, lineEnd);
+			ret[material];
+		} else if ((args = matchKeyword(cursor, lineEnd, "map_Kd"))) {
+			// the file name is the rest of the line after any options and may contain blanks
+			ret[material] = restOfLine(skipTextureOptions(args, lineEnd), lineEnd);
+		}
+		line = lineEnd + 1;
+	}
+	return ret;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "predef.h"
+
+#include <map>
+#include <string>
+
+#include "TypeUtil.h"
+#include "mapped_file.h"
+
+// Zero based position and texture coordinate indices of a face corner
+struct ObjCorner {
+	u32 position;
+	u32 texCoord;
+};
+
+// Consecutive triangles using one material, split wherever the file starts a group, an object or another material
+struct ObjGroup {
+	u32 baseTriangle;
+	u32 triangleCount;
+	std::string material;
+};
+
+// Geometry of an OBJ file in file order. Polygons are fan triangulated and texture coordinates are flipped
+// vertically to match the texture origin.
+struct ObjData {
+	std::vector<vec3> positions;
+	std::vector<vec2> texCoords;
+	std::vector<std::array<ObjCorner, 3>> triangles;
+	std::vector<ObjGroup> groups;
+	// files named on mtllib lines
+	std::vector<std::string> materialLibraries;
+};
+
+// Parses a memory mapped OBJ file. The file is split into line aligned chunks that are counted and then parsed in
+// parallel, every chunk writing its elements straight to their final place in the streams.
+// Normals and statements other than v, vt, f, g, o, usemtl and mtllib are ignored.
+ObjData parseObj(const MappedFile& file);
+
+// Diffuse texture file (map_Kd) of every material in an MTL file, empty for materials without one. The file name is
+// the rest of the line after the statement's options, so it may contain blanks.
+std::map<std::string, std::string> parseMaterialTextures(const MappedFile& file);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "predef.h"
+
+#include <string>
+
+#include "TypeUtil.h"
+
+// Order in which the meshes that pass culling are drawn
+enum class DrawOrder {
+	// as laid out in the scene
+	Scene,
+	// meshes sharing a texture back to back
+	Texture,
+	// nearest first by view space depth of their bounds, with their meshlets in a matching precomputed order
+	FrontToBack
+};
+
+// Settings parsed from the command line and handed to init
+struct Options {
+	bool renderOnce = false;
+	// OBJ file the scene is loaded from, relative to the resources directory
+	std::string scenePath = "sponza.obj";
+	// Render without a window or OpenGL, writing the frames to outputPath. Builds without GLFW are always headless.
+	bool headless = false;
+	// Frames rendered before a headless run exits
+	size_t frameCount = 1;
+	// Image file, PNG or PPM by extension, the frames of a headless run are written to. With several frames, the frame
+	// number is appended to the file name. "-" streams the frames to stdout as PPM images instead.
+	std::string outputPath = "frame.png";
+	// Frames measured by a benchmark run, 0 renders normally. Benchmarks run headless, move the camera along
+	// cameraPath and report frame time statistics instead of writing images.
+	size_t benchmarkFrames = 0;
+	// Frames rendered along the camera path before measuring, so lazily loaded textures and paged geometry settle
+	size_t warmupFrames = 10;
+	// Camera keyframe file for benchmarks, see CameraPath::load. Empty orbits the default view.
+	std::string cameraPath;
+	// File the benchmark report is written to as JSON, "-" for stdout
+	std::string benchmarkOutput = "-";
+	// Chrome trace JSON file the timeline of the run is written to on exit, empty to not trace. Needs a build with
+	// RASTER_TRACING.
+	std::string tracePath;
+	// Directory of reference images to compare against, empty to not compare. A golden run renders one frame per
+	// keyframe of cameraPath, or of the default view, and fails if any is further off its reference than
+	// goldenTolerance, writing the frame and a diff image next to the reference.
+	std::string goldenDir;
+	// Write the frames of a golden run as the new references instead of comparing against them
+	bool updateGolden = false;
+	// Difference per color channel a pixel of a golden run may have from its reference
+	u32 goldenTolerance = 2;
+	// Write per pixel overdraw images and histograms next to every frame of a headless run. Needs a build with
+	// RASTER_OVERDRAW.
+	bool overdraw = false;
+	// Overlap presenting a frame with rasterizing the next one and preparing the one after it, at the cost of frames
+	// coming out two frames after their camera was set. Benchmarks then measure frame throughput.
+	bool pipelined = false;
+	// Job system worker threads, 0 for one per hardware thread besides the main thread
+	size_t workerCount = 0;
+	// Pin every worker thread to its own core, Linux only
+	bool pinWorkers = false;
+	// Load textures on first sample instead of at startup
+	bool lazyTextures = false;
+	// Memory budget for resident textures in bytes, 0 for unlimited
+	size_t textureBudget = 0;
+	// Keep textures BC1/BC3 compressed in memory
+	bool compressedTextures = false;
+	// Reorder the triangles within every meshlet for vertex cache reuse when building the mesh cache
+	bool optimizeMeshes = false;
+	// Cull meshes and meshlets against the view frustum, and meshlets by their normal cone, before transforming
+	bool clusterCulling = true;
+	// Store positions as 16 bit integers, texture coordinates as half floats and small meshes' indices as 16 bits
+	bool quantizedVertices = false;
+	// Screen space error in pixels a mesh's level of detail may introduce, 0 always draws the full meshes. The error is
+	// the RMS estimate of MeshLod::error projected to the screen, single points may stray further.
+	float lodErrorPixels = 1.0f;
+	// Sorting texture batches improves texture cache reuse, front to back sorting lets the depth test reject more
+	// fragments before they are shaded
+	DrawOrder drawOrder = DrawOrder::Texture;
+	// Memory budget for resident scene geometry in bytes. Anything but 0 splits the scene into spatial chunks that are
+	// paged in as the camera approaches them. This bounds rendering from an existing mesh cache only, building the
+	// cache still holds the whole scene in memory.
+	size_t geometryBudget = 0;
+};
+
@@ -0,0 +1,88 @@
+#include "overdraw.h"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "converters.h"
+#include "image_writer.h"
+
+namespace {
+
+// Histograms count pixels with 0 to HISTOGRAM_BINS - 2 events, the last bin collects everything above
+constexpr u32 HISTOGRAM_BINS = 17;
+
+const Color PALETTE[] = {
+	{0, 0, 0, 255},
+	{0, 0, 255, 255},
+	{0, 255, 255, 255},
+	{0, 255, 0, 255},
+	{255, 255, 0, 255},
+	{255, 128, 0, 255},
+	{255, 0, 0, 255},
+	{255, 255, 255, 255}};
+
+uvec2 g_viewport;
+std::vector<OverdrawPixel> g_pixels;
+
+template <typename Count>
+void writeCounts(const std::string& stem, const char* name, Count count, std::ostream& histogramOut) {
+	std::vector<Color> colors(g_pixels.size());
+	std::vector<u64> histogram(HISTOGRAM_BINS);
+	u64 total = 0;
+	for (size_t i = 0; i < g_pixels.size(); ++i) {
+		auto value = count(g_pixels[i]);
+		colors[i] = PALETTE[std::min<size_t>(value, std::size(PALETTE) - 1)];
+		histogram[std::min(value, HISTOGRAM_BINS - 1)]++;
+		total += value;
+	}
+	writeImage(stem + "_" + name + ".png", g_viewport, colors.data());
+
+	histogramOut << "\t\"" << name << "\": {\"mean\": " << double(total) / g_pixels.size() << ", \"histogram\": [";
+	for (size_t bin = 0; bin < histogram.size(); ++bin) {
+		histogramOut << (bin ? ", " : "") << histogram[bin];
+	}
+	histogramOut << "]}";
+}
+
+}
+
+namespace detail {
+
+OverdrawPixel* g_overdraw = nullptr;
+
+}
+
+void enableOverdraw(const uvec2& viewport) {
+	if constexpr (!OVERDRAW) {
+		std::cerr << "Overdraw counting is not compiled in, configure with RASTER_OVERDRAW" << std::endl;
+		return;
+	}
+	g_viewport = viewport;
+	g_pixels.assign(size_t(viewport.x) * viewport.y, OverdrawPixel());
+	detail::g_overdraw = g_pixels.data();
+}
+
+void clearOverdraw() {
+	std::fill(g_pixels.begin(), g_pixels.end(), OverdrawPixel());
+}
+
+void writeOverdraw(const std::string& stem) {
+	if (g_pixels.empty()) {
+		return;
+	}
+
+	auto histogramPath = stem + "_overdraw.json";
+	std::ofstream histogramOut(histogramPath);
+	if (!histogramOut) {
+		std::cerr << "Could not open " << histogramPath << " for writing" << std::endl;
+		throw std::runtime_error("overdraw not written");
+	}
+
+	// bins are pixel counts with 0, 1, ... events, the last one counting every pixel with more
+	histogramOut << std::fixed << std::setprecision(3) << "{\n";
+	writeCounts(stem, "depth_tests", [](const OverdrawPixel& pixel) { return pixel.depthTests; }, histogramOut);
+	histogramOut << ",\n";
+	writeCounts(stem, "depth_passes", [](const OverdrawPixel& pixel) { return pixel.depthPasses; }, histogramOut);
+	histogramOut << "\n}" << std::endl;
+}
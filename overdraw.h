@@ -0,0 +1,41 @@
+#pragma once
+
+#include "predef.h"
+
+#include <string>
+
+#include "TypeUtil.h"
+
+// Per pixel overdraw counting is only compiled into builds with RASTER_OVERDRAW defined
+#ifdef RASTER_OVERDRAW
+constexpr bool OVERDRAW = true;
+#else
+constexpr bool OVERDRAW = false;
+#endif
+
+// What the raster loop did at one pixel during a frame
+struct OverdrawPixel {
+	// fragments covering the pixel, each of which is depth tested
+	u32 depthTests = 0;
+	// every fragment passing the depth test is shaded, so these are the shader invocations too
+	u32 depthPasses = 0;
+};
+
+namespace detail {
+
+// The pixels counted into, laid out like the color buffer, or null while not counting
+extern OverdrawPixel* g_overdraw;
+
+}
+
+// Starts counting overdraw for frames of the viewport's size. Counting is not thread safe, the raster loop has to
+// run on one thread at a time.
+void enableOverdraw(const uvec2& viewport);
+
+// Resets every pixel's counts, at the start of a frame
+void clearOverdraw();
+
+// Writes the counts of the last frame as false color images, "<stem>_depth_tests.png" and
+// "<stem>_depth_passes.png", and their histograms as "<stem>_overdraw.json". The colors go from black for
+// 0 over blue, cyan, green, yellow and orange to red for 6 and white for more.
+void writeOverdraw(const std::string& stem);
@@ -0,0 +1,379 @@
+#include "parallel.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+#include "trace.h"
+
+namespace detail {
+
+struct JobState {
+	std::function<void()> body;
+	// guards dependents and error until the job is done
+	std::mutex lock;
+	std::vector<Job> dependents;
+	std::exception_ptr error;
+	// unfinished dependencies, plus one held by submitJob while it registers them
+	std::atomic<u32> blockers{1};
+	std::atomic<u32> waiters{0};
+	std::atomic<bool> done{false};
+};
+
+}
+
+namespace {
+
+using detail::JobState;
+
+struct WorkerQueue {
+	std::mutex lock;
+	std::deque<Job> jobs;
+	// only the owning worker adds to the statistics, takeWorkerStats reads and resets them
+	std::atomic<u64> jobCount{0};
+	std::atomic<u64> steals{0};
+	std::atomic<u64> busyNanoseconds{0};
+};
+
+class Scheduler;
+
+// The scheduler the calling thread is a worker of and its index, null and 0 on other threads
+thread_local Scheduler* t_scheduler = nullptr;
+thread_local size_t t_worker = 0;
+
+void pinToCore(std::thread& thread, size_t core) {
+#ifdef __linux__
+	cpu_set_t cores;
+	CPU_ZERO(&cores);
+	CPU_SET(core % std::max(1u, std::thread::hardware_concurrency()), &cores);
+	if (pthread_setaffinity_np(thread.native_handle(), sizeof(cores), &cores) != 0) {
+		std::cerr << "Could not pin a worker to core " << core << std::endl;
+	}
+#else
+	(void)thread;
+	(void)core;
+#endif
+}
+
+class Scheduler {
+public:
+	Scheduler(size_t workerCount, bool pinWorkers) : m_statsStart(std::chrono::steady_clock::now()) {
+		for (size_t i = 0; i < workerCount; ++i) {
+			m_queues.push_back(std::make_unique<WorkerQueue>());
+		}
+		for (size_t i = 0; i < workerCount; ++i) {
+			m_workers.emplace_back([this, i]() { workerLoop(i); });
+			if (pinWorkers) {
+				pinToCore(m_workers.back(), i + 1);
+			}
+		}
+	}
+
+	// Runs every queued job before the workers exit
+	~Scheduler() {
+		{
+			std::lock_guard<std::mutex> guard(m_sleepLock);
+			m_stopping = true;
+		}
+		m_wake.notify_all();
+		for (auto& worker : m_workers) {
+			worker.join();
+		}
+	}
+
+	Scheduler(const Scheduler&) = delete;
+	Scheduler& operator=(const Scheduler&) = delete;
+
+	size_t workerCount() const { return m_workers.size(); }
+
+	// Queues a job whose dependencies finished, on the calling worker's own deque or spread over the workers
+	void push(Job job) {
+		auto queue = t_scheduler == this ? t_worker : m_nextQueue++ % m_queues.size();
+		{
+			std::lock_guard<std::mutex> guard(m_queues[queue]->lock);
+			m_queues[queue]->jobs.push_back(std::move(job));
+		}
+		m_queued++;
+		{
+			std::lock_guard<std::mutex> guard(m_sleepLock);
+		}
+		m_wake.notify_one();
+	}
+
+	void wait(const Job& job) {
+		while (!job->done) {
+			if (auto next = findJob()) {
+				run(next);
+				continue;
+			}
+
+			job->waiters++;
+			{
+				std::unique_lock<std::mutex> guard(m_sleepLock);
+				if (!job->done && m_queued == 0) {
+					m_wake.wait(guard);
+				}
+			}
+			job->waiters--;
+		}
+	}
+
+	// Marks the job done and queues the dependents it was the last unfinished dependency of
+	void finish(const Job& job) {
+		std::vector<Job> dependents;
+		{
+			std::lock_guard<std::mutex> guard(job->lock);
+			job->done = true;
+			dependents.swap(job->dependents);
+		}
+
+		for (auto& dependent : dependents) {
+			if (job->error) {
+				std::lock_guard<std::mutex> guard(dependent->lock);
+				if (!dependent->error) {
+					dependent->error = job->error;
+				}
+			}
+			if (--dependent->blockers == 0) {
+				push(std::move(dependent));
+			}
+		}
+
+		if (job->waiters > 0) {
+			{
+				std::lock_guard<std::mutex> guard(m_sleepLock);
+			}
+			m_wake.notify_all();
+		}
+	}
+
+	std::vector<WorkerStats> takeStats() {
+		auto now = std::chrono::steady_clock::now();
+		std::lock_guard<std::mutex> guard(m_statsLock);
+		std::vector<WorkerStats> ret;
+		for (auto& queue : m_queues) {
+			WorkerStats stats;
+			stats.jobs = queue->jobCount.exchange(0, std::memory_order_relaxed);
+			stats.steals = queue->steals.exchange(0, std::memory_order_relaxed);
+			stats.busy = std::chrono::nanoseconds(queue->busyNanoseconds.exchange(0, std::memory_order_relaxed));
+			stats.elapsed = now - m_statsStart;
+			ret.push_back(stats);
+		}
+		m_statsStart = now;
+		return ret;
+	}
+
+private:
+	// Pops the newest job of the calling worker's own deque, or steals the oldest one of another deque
+	Job findJob() {
+		auto own = t_scheduler == this;
+		auto first = own ? t_worker : 0;
+		for (size_t i = 0; i < m_queues.size(); ++i) {
+			auto& queue = *m_queues[(first + i) % m_queues.size()];
+			std::lock_guard<std::mutex> guard(queue.lock);
+			if (queue.jobs.empty()) {
+				continue;
+			}
+
+			Job ret;
+			if (own && i == 0) {
+				ret = std::move(queue.jobs.back());
+				queue.jobs.pop_back();
+			} else {
+				ret = std::move(queue.jobs.front());
+				queue.jobs.pop_front();
+				if (own) {
+					m_queues[t_worker]->steals.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+			m_queued--;
+			return ret;
+		}
+		return nullptr;
+	}
+
+	void run(const Job& job) {
+		if (!job->error) {
+			try {
+				job->body();
+			} catch (...) {
+				std::lock_guard<std::mutex> guard(job->lock);
+				job->error = std::current_exception();
+			}
+		}
+		job->body = nullptr;
+		finish(job);
+	}
+
+	void workerLoop(size_t index) {
+		t_scheduler = this;
+		t_worker = index;
+		setTraceThreadName("worker " + std::to_string(index));
+		auto& stats = *m_queues[index];
+
+		while (true) {
+			if (auto job = findJob()) {
+				auto start = std::chrono::steady_clock::now();
+				run(job);
+				auto busy = std::chrono::steady_clock::now() - start;
+				stats.jobCount.fetch_add(1, std::memory_order_relaxed);
+				stats.busyNanoseconds.fetch_add(
+					std::chrono::duration_cast<std::chrono::nanoseconds>(busy).count(), std::memory_order_relaxed);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> guard(m_sleepLock);
+			if (m_queued > 0) {
+				continue;
+			}
+			if (m_stopping) {
+				return;
+			}
+			m_wake.wait(guard);
+		}
+	}
+
+	std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+	std::vector<std::thread> m_workers;
+	std::atomic<size_t> m_nextQueue{0};
+	// jobs in any deque
+	std::atomic<size_t> m_queued{0};
+
+	// sleeping workers and waiting threads are woken through m_wake, m_sleepLock orders their checks against it
+	std::mutex m_sleepLock;
+	std::condition_variable m_wake;
+	bool m_stopping = false;
+
+	std::mutex m_statsLock;
+	std::chrono::steady_clock::time_point m_statsStart;
+};
+
+std::mutex g_schedulerLock;
+// Started on first use and never destroyed, so the jobs of objects destroyed at exit can still finish
+std::atomic<Scheduler*> g_scheduler{nullptr};
+size_t g_workerCount = 0;
+bool g_pinWorkers = false;
+
+Scheduler& scheduler() {
+	if (auto ret = g_scheduler.load(std::memory_order_acquire)) {
+		return *ret;
+	}
+
+	std::lock_guard<std::mutex> guard(g_schedulerLock);
+	if (!g_scheduler.load(std::memory_order_relaxed)) {
+		// at least one worker, so jobs nobody waits for still run on a single core
+		auto workerCount = g_workerCount > 0 ? g_workerCount : std::max(2u, std::thread::hardware_concurrency()) - 1;
+		g_scheduler.store(new Scheduler(workerCount, g_pinWorkers), std::memory_order_release);
+	}
+	return *g_scheduler.load(std::memory_order_relaxed);
+}
+
+}
+
+void configureJobSystem(size_t workerCount, bool pinWorkers) {
+#ifndef __linux__
+	if (pinWorkers) {
+		std::cerr << "Pinning workers to cores is only supported on Linux" << std::endl;
+		pinWorkers = false;
+	}
+#endif
+	std::lock_guard<std::mutex> guard(g_schedulerLock);
+	g_workerCount = workerCount;
+	g_pinWorkers = pinWorkers;
+	delete g_scheduler.exchange(nullptr);
+}
+
+size_t jobWorkerCount() {
+	return scheduler().workerCount();
+}
+
+Job submitJob(std::function<void()> body, const std::vector<Job>& dependencies) {
+	auto job = std::make_shared<JobState>();
+	job->body = std::move(body);
+	for (const auto& dependency : dependencies) {
+		std::lock_guard<std::mutex> guard(dependency->lock);
+		if (!dependency->done) {
+			job->blockers++;
+			dependency->dependents.push_back(job);
+		} else if (dependency->error) {
+			std::lock_guard<std::mutex> jobGuard(job->lock);
+			if (!job->error) {
+				job->error = dependency->error;
+			}
+		}
+	}
+
+	if (--job->blockers == 0) {
+		scheduler().push(job);
+	}
+	return job;
+}
+
+bool jobDone(const Job& job) {
+	return job->done;
+}
+
+void waitForJob(const Job& job) {
+	// finished jobs are checked first, objects destroyed at exit wait for theirs after the workers are gone
+	if (!job->done) {
+		scheduler().wait(job);
+	}
+
+	std::lock_guard<std::mutex> guard(job->lock);
+	if (job->error) {
+		std::rethrow_exception(job->error);
+	}
+}
+
+void parallelFor(size_t count, const std::function<void(size_t)>& body) {
+	auto helperCount = count > 1 ? std::min(jobWorkerCount(), count - 1) : 0;
+	if (helperCount == 0) {
+		for (size_t i = 0; i < count; ++i) {
+			TraceScope trace("job", i);
+			body(i);
+		}
+		return;
+	}
+
+	std::atomic<size_t> next{0};
+	std::exception_ptr error;
+	std::mutex errorLock;
+
+	auto work = [&]() {
+		for (auto i = next++; i < count; i = next++) {
+			try {
+				TraceScope trace("job", i);
+				body(i);
+			} catch (...) {
+				std::lock_guard<std::mutex> guard(errorLock);
+				if (!error) {
+					error = std::current_exception();
+				}
+				next = count;
+			}
+		}
+	};
+
+	// the helpers take indices alongside the calling thread, ones that start late find none left
+	std::vector<Job> helpers;
+	for (size_t i = 0; i < helperCount; ++i) {
+		helpers.push_back(submitJob(work));
+	}
+	work();
+	for (const auto& helper : helpers) {
+		waitForJob(helper);
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+std::vector<WorkerStats> takeWorkerStats() {
+	return scheduler().takeStats();
+}
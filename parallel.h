@@ -0,0 +1,55 @@
+#pragma once
+
+#include "predef.h"
+
+#include <memory>
+
+#include "TypeUtil.h"
+
+// Work stealing job system. Every worker thread owns a deque of jobs, runs its own jobs newest first and steals the
+// oldest ones of other workers when it runs dry. Threads waiting for a job run queued jobs in the meantime, so jobs
+// may wait for other jobs.
+
+namespace detail {
+
+struct JobState;
+
+}
+
+// Handle to a submitted job, to wait for it or to make other jobs depend on it
+using Job = std::shared_ptr<detail::JobState>;
+
+// What a worker thread did since the previous takeWorkerStats
+struct WorkerStats {
+	u64 jobs = 0;
+	// jobs taken from another worker's deque
+	u64 steals = 0;
+	std::chrono::nanoseconds busy{0};
+	std::chrono::nanoseconds elapsed{0};
+
+	double utilization() const { return elapsed.count() > 0 ? double(busy.count()) / elapsed.count() : 0.0; }
+};
+
+// Sets the number of worker threads, 0 for one per hardware thread besides the calling one, and whether worker i is
+// pinned to core i + 1, leaving core 0 to the calling thread. Pinning is only supported on Linux. Replaces the
+// running workers after they finished every queued job, so it must not be called while jobs are submitted.
+void configureJobSystem(size_t workerCount, bool pinWorkers);
+
+size_t jobWorkerCount();
+
+// Queues body to run on a worker once every dependency finished. If a dependency threw, body does not run and the
+// job rethrows the dependency's exception when waited for.
+Job submitJob(std::function<void()> body, const std::vector<Job>& dependencies = {});
+
+bool jobDone(const Job& job);
+
+// Returns once the job finished, running queued jobs meanwhile, and rethrows the exception the job threw
+void waitForJob(const Job& job);
+
+// Runs body(i) for every i in [0, count) on the calling thread and the workers and returns once all calls finished.
+// Indices are handed out dynamically, so uneven work items balance themselves. The first exception thrown
+// by any call is rethrown on the calling thread.
+void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+// Per worker statistics since the previous call, or since the workers started
+std::vector<WorkerStats> takeWorkerStats();
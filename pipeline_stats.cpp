@@ -0,0 +1,97 @@
+#include "pipeline_stats.h"
+
+#include <atomic>
+#include <iterator>
+#include <mutex>
+
+namespace {
+
+// A thread's statistics. Only the owning thread adds to them, takePipelineStats reads and resets them from another
+// thread, which relaxed atomics make safe without a lock on the recording side.
+struct ThreadStats {
+	std::array<std::atomic<u64>, PIPELINE_STAGE_COUNT> ticks{};
+	std::array<std::atomic<u64>, PIPELINE_COUNTER_COUNT> counts{};
+
+	ThreadStats();
+	~ThreadStats();
+};
+
+std::mutex g_registryLock;
+std::vector<ThreadStats*> g_threadStats;
+// statistics of threads that exited since the last takePipelineStats
+PipelineStats g_exitedThreadStats;
+
+template <size_t N>
+void add(std::array<std::atomic<u64>, N>& to, const std::array<u64, N>& values) {
+	for (size_t i = 0; i < N; ++i) {
+		to[i].fetch_add(values[i], std::memory_order_relaxed);
+	}
+}
+
+template <size_t N>
+void take(std::array<u64, N>& to, std::array<std::atomic<u64>, N>& from) {
+	for (size_t i = 0; i < N; ++i) {
+		to[i] += from[i].exchange(0, std::memory_order_relaxed);
+	}
+}
+
+ThreadStats::ThreadStats() {
+	std::lock_guard<std::mutex> lock(g_registryLock);
+	g_threadStats.push_back(this);
+}
+
+ThreadStats::~ThreadStats() {
+	std::lock_guard<std::mutex> lock(g_registryLock);
+	take(g_exitedThreadStats.ticks, ticks);
+	take(g_exitedThreadStats.counts, counts);
+	g_threadStats.erase(std::find(g_threadStats.begin(), g_threadStats.end(), this));
+}
+
+}
+
+const char* pipelineStageName(PipelineStage stage) {
+	static const char* NAMES[] = {"transform", "clip", "setup", "raster", "shade"};
+	static_assert(std::size(NAMES) == PIPELINE_STAGE_COUNT, "every stage needs a name");
+	return NAMES[size_t(stage)];
+}
+
+const char* pipelineCounterName(PipelineCounter counter) {
+	static const char* NAMES[] = {
+		"verticesTransformed",
+		"trianglesIn", "trianglesClipped", "trianglesCulled",
+		"fragmentsTested", "fragmentsPassed", "fragmentsShaded", "depthRejects"};
+	static_assert(std::size(NAMES) == PIPELINE_COUNTER_COUNT, "every counter needs a name");
+	return NAMES[size_t(counter)];
+}
+
+PipelineStats& PipelineStats::operator+=(const PipelineStats& other) {
+	for (size_t i = 0; i < PIPELINE_STAGE_COUNT; ++i) {
+		ticks[i] += other.ticks[i];
+	}
+	for (size_t i = 0; i < PIPELINE_COUNTER_COUNT; ++i) {
+		counts[i] += other.counts[i];
+	}
+	return *this;
+}
+
+void addThreadPipelineStats(const PipelineStats& stats) {
+	if constexpr (PIPELINE_STATS) {
+		thread_local ThreadStats threadStats;
+		add(threadStats.ticks, stats.ticks);
+		add(threadStats.counts, stats.counts);
+	}
+}
+
+PipelineStats takePipelineStats() {
+	PipelineStats ret;
+	if constexpr (PIPELINE_STATS) {
+		std::lock_guard<std::mutex> lock(g_registryLock);
+		ret = g_exitedThreadStats;
+		g_exitedThreadStats = PipelineStats();
+		for (auto* threadStats : g_threadStats) {
+			take(ret.ticks, threadStats->ticks);
+			take(ret.counts, threadStats->counts);
+		}
+	}
+	return ret;
+}
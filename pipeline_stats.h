@@ -0,0 +1,87 @@
+#pragma once
+
+#include "predef.h"
+
+#include "TypeUtil.h"
+
+// Pipeline statistics are only gathered in builds with RASTER_PIPELINE_STATS defined, otherwise recording them
+// compiles to nothing and every statistic reads as 0.
+#ifdef RASTER_PIPELINE_STATS
+constexpr bool PIPELINE_STATS = true;
+#else
+constexpr bool PIPELINE_STATS = false;
+#endif
+
+// Timed stages. Raster covers the pixel loop of a triangle, shading included.
+enum class PipelineStage {
+	Transform,
+	Clip,
+	Setup,
+	Raster,
+	Shade,
+	Count
+};
+
+enum class PipelineCounter {
+	VerticesTransformed,
+	// triangles handed to the rasterizer
+	TrianglesIn,
+	// triangles entirely outside the view volume
+	TrianglesClipped,
+	// triangles inside the view volume that are back-facing or degenerate
+	TrianglesCulled,
+	// pixels tested against a triangle's edges
+	FragmentsTested,
+	// fragments inside their triangle
+	FragmentsPassed,
+	// fragments that passed the depth test and were shaded
+	FragmentsShaded,
+	// fragments behind what the depth buffer already holds
+	DepthRejects,
+	Count
+};
+
+constexpr size_t PIPELINE_STAGE_COUNT = size_t(PipelineStage::Count);
+constexpr size_t PIPELINE_COUNTER_COUNT = size_t(PipelineCounter::Count);
+
+const char* pipelineStageName(PipelineStage stage);
+const char* pipelineCounterName(PipelineCounter counter);
+
+// Time stamp counter ticks on x86, nanoseconds elsewhere, and always 0 without pipeline statistics
+inline u64 pipelineTicks();
+
+// Ticks spent in every stage and the pipeline counters. Code in the pipeline fills a local instance and adds it to
+// its thread's statistics when done, so the hot loops only touch locals.
+struct PipelineStats {
+	std::array<u64, PIPELINE_STAGE_COUNT> ticks{};
+	std::array<u64, PIPELINE_COUNTER_COUNT> counts{};
+
+	void count(PipelineCounter counter, u64 amount = 1) {
+		if constexpr (PIPELINE_STATS) {
+			counts[size_t(counter)] += amount;
+		}
+	}
+
+	// Adds the ticks since start to the stage and returns the current ticks, so consecutive stages chain
+	u64 time(PipelineStage stage, u64 start) {
+		if constexpr (PIPELINE_STATS) {
+			auto now = pipelineTicks();
+			ticks[size_t(stage)] += now - start;
+			return now;
+		}
+		return 0;
+	}
+
+	u64 operator[](PipelineStage stage) const { return ticks[size_t(stage)]; }
+	u64 operator[](PipelineCounter counter) const { return counts[size_t(counter)]; }
+
+	PipelineStats& operator+=(const PipelineStats& other);
+};
+
+// Adds to the calling thread's statistics. Every thread keeps its own, so recording never contends.
+void addThreadPipelineStats(const PipelineStats& stats);
+
+// Sums the statistics recorded by all threads since the last call and resets them
+PipelineStats takePipelineStats();
+
+#include "pipeline_stats.inl"
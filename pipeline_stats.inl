@@ -0,0 +1,16 @@
+#if defined(RASTER_PIPELINE_STATS) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+inline u64 pipelineTicks() {
+#ifdef RASTER_PIPELINE_STATS
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+#else
+	return 0;
+#endif
+}
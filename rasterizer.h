@@ -1,11 +1,15 @@
 #pragma once
 
 #include "converters.h"
+#include "overdraw.h"
+#include "pipeline_stats.h"
 #include "predef.h"
 #include "TypeUtil.h"
 #include "user_data.h"
 
 constexpr auto SUBPIXEL = 1 << 4;
+const float DEPTH_BUFFER_CLEAR = std::numeric_limits<float>::max();
+const Color COLOR_BUFFER_CLEAR = {0, 0, 0, 1};
 
 template <typename T, typename Impl>
 struct MiniFragmentShader {
@@ -17,12 +21,54 @@ struct MiniFragmentShader {
 	}
 };
 
+// Resets every pixel of the render targets to the clear values
+void clearTargets(const uvec2& viewport, float* depthBuffer, Color* colorBuffer);
+
+// Writes the clip space position of vertecies[i] to transformed[i], in parallel chunks
+void transformVertecies(Span<const vec3> vertecies, const mat4& mvp, vec4* transformed);
+
+// A fan piece of a clipped triangle that faces the camera, ready to be rasterized
+template <typename FragmentShader>
+struct SetupTriangle;
+
+// Clips and sets up triangles whose vertices were already transformed into clip space, in parallel chunks, and
+// appends the pieces to rasterize to out in the order of the triangles
+template <typename FragmentShader, typename Index>
+void setupTransformedTriangles(
+	const uvec2& viewport, 
+	Span<const vec4> transformedVertecies, 
+	Span<const typename FragmentShader::Input> colors, 
+	Span<const std::array<Index, 3>> indices, 
+	std::vector<SetupTriangle<FragmentShader>>& out);
+
+// Rasterizes set up triangles in order on the calling thread
+template <typename FragmentShader>
+void rasterSetupTriangles(
+	const uvec2& viewport, 
+	Span<const SetupTriangle<FragmentShader>> triangles, 
+	FragmentShader& fs,
+	float* depthBuffer, 
+	Color* colorBuffer);
+
+// Clips, sets up and rasterizes triangles whose vertices were already transformed into clip space. Clipping and
+// setup run in parallel chunks, rasterization on the calling thread in the order of the triangles. The pipeline
+// statistics of every stage are added to the threads that did the work.
+template <typename FragmentShader, typename Index>
+void rasterTransformedTriangles(
+	const uvec2& viewport, 
+	Span<const vec4> transformedVertecies, 
+	Span<const typename FragmentShader::Input> colors, 
+	Span<const std::array<Index, 3>> indices, 
+	FragmentShader& fs,
+	float* depthBuffer, 
+	Color* colorBuffer);
+
 template <typename FragmentShader>
 void rasterTriangleIndexed(
 	const uvec2& viewport, 
-	const std::vector<vec3>& vertecies, 
-	const std::vector<typename FragmentShader::Input>& colors, 
-	const std::vector<std::array<uint32_t, 3>>& indices, 
+	Span<const vec3> vertecies, 
+	Span<const typename FragmentShader::Input> colors, 
+	Span<const std::array<uint32_t, 3>> indices, 
 	const mat4& mvp, 
 	FragmentShader fs,
 	float* depthBuffer, 
@@ -1,15 +1,16 @@
 #include "clipping.h"
+#include "parallel.h"
 #include "RasterUtil.h"
 
 namespace detail {
 
-u16vec2 rasterFromNDC(const vec4& clip, const vec2& viewport) {
+inline u16vec2 rasterFromNDC(const vec4& clip, const vec2& viewport) {
 	auto shiftedNdcX = 1 + clip.x / clip.w;
 	auto shiftedNdcY = 1 - clip.y / clip.w;
 	return {shiftedNdcX * viewport.x / 2, shiftedNdcY * viewport.y / 2};
 }
 
-float normalizeDepth(const vec4& v) {
+inline float normalizeDepth(const vec4& v) {
 	return (1 + v.z / v.w) * 0.5f;
 }
 
@@ -41,25 +42,95 @@ struct TriangleRecord {
 	vec3 oneOverW;
 };
 
+// Tests every pixel of the viewport against the triangle's edges, then depth tests and shades the covered ones.
+// Overdraw builds count what happened at every pixel while overdraw counting is enabled.
+template <typename FragmentShader>
+void rasterPixels(
+	const uvec2& viewport,
+	const TriangleRecord& record,
+	const glm::mat<3, FragmentShader::InputDimension, float>& clippedColor,
+	FragmentShader& fs,
+	float* depthBuffer,
+	Color* colorBuffer,
+	PipelineStats& stats) {
+	for (auto y = 0; y < viewport.y; ++y) {
+		for (auto x = 0; x < viewport.x; ++x) {
+			auto sample = SUBPIXEL * ivec3(2 * x + 1, 2 * y + 1, 2);
+			auto insides = record.edges * sample;
+
+			if (all(lessThanEqual(insides, ivec3(0)))) {
+				auto bufferIdx = (viewport.y - 1 - y) * viewport.x + x;
+				auto insidesNormalize = 1 / static_cast<float>(static_cast<i64>(record.area) * SUBPIXEL * 2);
+
+				vec2 barysRaw(insides.x * insidesNormalize, insides.y * insidesNormalize);
+				vec3 barys(barysRaw.x, barysRaw.y, 1 - barysRaw.x - barysRaw.y);
+
+				auto z = dot(barys, record.interpolatedZ);
+				stats.count(PipelineCounter::FragmentsPassed);
+				auto overdraw = OVERDRAW && detail::g_overdraw ? &detail::g_overdraw[bufferIdx] : nullptr;
+				if (overdraw) {
+					overdraw->depthTests++;
+				}
+
+				if (z <= depthBuffer[bufferIdx]) {
+					depthBuffer[bufferIdx] = z;
+					if (overdraw) {
+						overdraw->depthPasses++;
+					}
+
+					auto shadeTicks = pipelineTicks();
+					auto interpolatedData = clippedColor * (record.oneOverW * barys) / dot(record.oneOverW, barys);
+					auto resultColor = fs.shade(interpolatedData); 
+					colorBuffer[bufferIdx] = mkColor(resultColor);
+					stats.time(PipelineStage::Shade, shadeTicks);
+					stats.count(PipelineCounter::FragmentsShaded);
+				} else {
+					stats.count(PipelineCounter::DepthRejects);
+				}
+			}
+		}
+	}
+}
+
+}
+
+inline void clearTargets(const uvec2& viewport, float* depthBuffer, Color* colorBuffer) {
+	std::fill(depthBuffer, depthBuffer + size_t(viewport.x) * viewport.y, DEPTH_BUFFER_CLEAR);
+	std::fill(colorBuffer, colorBuffer + size_t(viewport.x) * viewport.y, COLOR_BUFFER_CLEAR);
+}
+
+namespace detail {
+
+// Vertices per transform job and triangles per setup job. Draws of up to one chunk stay on the calling thread.
+constexpr size_t TRANSFORM_CHUNK = 2048;
+constexpr size_t SETUP_CHUNK = 512;
+
+inline size_t chunkCount(size_t count, size_t chunk) {
+	return (count + chunk - 1) / chunk;
+}
+
 }
 
 template <typename FragmentShader>
-void rasterTriangleIndexed(
-	const uvec2& viewport, 
-	const std::vector<vec3>& vertecies, 
-	const std::vector<typename FragmentShader::Input>& colors, 
-	const std::vector<std::array<uint32_t, 3>>& indices, 
-	const mat4& mvp, 
-	FragmentShader fs,
-	float* depthBuffer, 
-	Color* colorBuffer) {
-	std::vector<vec4> transformedVertecies(vertecies.size());
+struct SetupTriangle {
+	detail::TriangleRecord record;
+	// the shader inputs at the piece's corners
+	glm::mat<3, FragmentShader::InputDimension, float> clippedColor;
+};
 
-	for (size_t i = 0; i < vertecies.size(); ++i) {
-		transformedVertecies[i] = mvp * vec4(vertecies[i], 1.0f);
-	}
+namespace detail {
 
+// Clips the triangles and appends the fan pieces to rasterize to out, in the order of the triangles
+template <typename FragmentShader, typename Index>
+void setupTriangles(
+	const uvec2& viewport,
+	Span<const vec4> transformedVertecies,
+	Span<const typename FragmentShader::Input> colors,
+	Span<const std::array<Index, 3>> indices,
+	std::vector<SetupTriangle<FragmentShader>>& out,
+	PipelineStats& stats) {
 	for (size_t triangleIndex = 0; triangleIndex < indices.size(); ++triangleIndex) {
+		auto ticks = pipelineTicks();
 		Triangle raw{
 			transformedVertecies[indices[triangleIndex][0]],
 			transformedVertecies[indices[triangleIndex][1]],
@@ -70,54 +141,137 @@ void rasterTriangleIndexed(
 		const auto d1 = raw.v1 - raw.v0;
 		const auto d2 = raw.v2 - raw.v0;
 		auto vertexCount = clip(raw, coeffs);
+		ticks = stats.time(PipelineStage::Clip, ticks);
+		stats.count(PipelineCounter::TrianglesIn);
+		if (vertexCount < 3) {
+			stats.count(PipelineCounter::TrianglesClipped);
+		}
+		auto rasterized = false;
 		
 		auto v0Clip = v0 + d1 * coeffs[0].x + d2 * coeffs[0].y;
-		auto v1Clip = v0 + d1 * coeffs[1].x + d2 * coeffs[1].y;
-		for (auto i = 2; i < vertexCount; ++i) {
+		for (size_t i = 2; i < vertexCount; ++i) {
 			auto v1Clip = v0 + d1 * coeffs[i - 1].x + d2 * coeffs[i - 1].y;
 			auto v2Clip = v0 + d1 * coeffs[i].x + d2 * coeffs[i].y;
 
-			detail::TriangleRecord record(v0Clip, v1Clip, v2Clip, viewport);
+			TriangleRecord record(v0Clip, v1Clip, v2Clip, viewport);
 			
 			if (record.area >= 0) {
 				// degenerate and back-facing triangles are ignored
 				continue; 
 			}
+			rasterized = true;
 
 			const auto origC0 = colors[indices[triangleIndex][0]];
 			const auto origC1 = colors[indices[triangleIndex][1]];
 			const auto origC2 = colors[indices[triangleIndex][2]];
-			const glm::mat<3, FragmentShader::InputDimension, float> clippedColor{
+			out.push_back({record, {
 				origC0 + (origC1 - origC0) * coeffs[0].x + (origC2 - origC0) * coeffs[0].y,
 				origC0 + (origC1 - origC0) * coeffs[i - 1].x + (origC2 - origC0) * coeffs[i - 1].y,
 				origC0 + (origC1 - origC0) * coeffs[i].x + (origC2 - origC0) * coeffs[i].y
-			};
+			}});
+		}
+		stats.time(PipelineStage::Setup, ticks);
 
-			for (auto y = 0; y < viewport.y; ++y) {
-				for (auto x = 0; x < viewport.x; ++x) {
-					auto sample = SUBPIXEL * ivec3(2 * x + 1, 2 * y + 1, 2);
-					auto insides = record.edges * sample;
+		if (vertexCount >= 3 && !rasterized) {
+			stats.count(PipelineCounter::TrianglesCulled);
+		}
+	}
+}
 
-					if (all(lessThanEqual(insides, ivec3(0)))) {
-						auto bufferIdx = (viewport.y - 1 - y) * viewport.x + x;
-						auto insidesNormalize = 1 / static_cast<float>(static_cast<i64>(record.area) * SUBPIXEL * 2);
+}
 
-						vec2 barysRaw(insides.x * insidesNormalize, insides.y * insidesNormalize);
-						vec3 barys(barysRaw.x, barysRaw.y, 1 - barysRaw.x - barysRaw.y);
+inline void transformVertecies(Span<const vec3> vertecies, const mat4& mvp, vec4* transformed) {
+	parallelFor(detail::chunkCount(vertecies.size(), detail::TRANSFORM_CHUNK), [&](size_t chunk) {
+		PipelineStats stats;
+		auto ticks = pipelineTicks();
+		auto end = std::min(vertecies.size(), (chunk + 1) * detail::TRANSFORM_CHUNK);
+		for (auto i = chunk * detail::TRANSFORM_CHUNK; i < end; ++i) {
+			transformed[i] = mvp * vec4(vertecies[i], 1.0f);
+		}
+		stats.time(PipelineStage::Transform, ticks);
+		stats.count(PipelineCounter::VerticesTransformed, end - chunk * detail::TRANSFORM_CHUNK);
+		addThreadPipelineStats(stats);
+	});
+}
 
-						auto z = dot(barys, record.interpolatedZ);
+template <typename FragmentShader, typename Index>
+void setupTransformedTriangles(
+	const uvec2& viewport, 
+	Span<const vec4> transformedVertecies, 
+	Span<const typename FragmentShader::Input> colors, 
+	Span<const std::array<Index, 3>> indices, 
+	std::vector<SetupTriangle<FragmentShader>>& out) {
+	// one buffer per chunk, so setup jobs write without locks and appending the chunks in turn keeps primitive
+	// order. Reused across draws, so steady-state submission does not allocate. The buffers belong to the calling
+	// thread and are handed to the jobs by reference, naming the thread_local inside a job would find the worker's.
+	static thread_local std::vector<std::vector<SetupTriangle<FragmentShader>>> callerSetupChunks;
+	auto& setupChunks = callerSetupChunks;
+	auto chunkCount = detail::chunkCount(indices.size(), detail::SETUP_CHUNK);
+	if (setupChunks.size() < chunkCount) {
+		setupChunks.resize(chunkCount);
+	}
 
-						if (z <= depthBuffer[bufferIdx]) {
-							depthBuffer[bufferIdx] = z;
+	parallelFor(chunkCount, [&](size_t chunk) {
+		PipelineStats stats;
+		auto& chunkOut = setupChunks[chunk];
+		chunkOut.clear();
+		auto first = chunk * detail::SETUP_CHUNK;
+		detail::setupTriangles(viewport, transformedVertecies, colors,
+			indices.subspan(first, std::min(detail::SETUP_CHUNK, indices.size() - first)), chunkOut, stats);
+		addThreadPipelineStats(stats);
+	});
 
-							auto interpolatedData = clippedColor * (record.oneOverW * barys) / dot(record.oneOverW, barys);
-							auto resultColor = fs.shade(interpolatedData); 
-							colorBuffer[bufferIdx] = mkColor(resultColor);
-						}
-					}
-				}
-			}
-		}
+	for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+		out.insert(out.end(), setupChunks[chunk].begin(), setupChunks[chunk].end());
 	}
 }
 
+template <typename FragmentShader>
+void rasterSetupTriangles(
+	const uvec2& viewport, 
+	Span<const SetupTriangle<FragmentShader>> triangles, 
+	FragmentShader& fs,
+	float* depthBuffer, 
+	Color* colorBuffer) {
+	PipelineStats stats;
+	for (const auto& triangle : triangles) {
+		auto ticks = pipelineTicks();
+		stats.count(PipelineCounter::FragmentsTested, u64(viewport.x) * viewport.y);
+		detail::rasterPixels(viewport, triangle.record, triangle.clippedColor, fs, depthBuffer, colorBuffer, stats);
+		stats.time(PipelineStage::Raster, ticks);
+	}
+	addThreadPipelineStats(stats);
+}
+
+template <typename FragmentShader, typename Index>
+void rasterTransformedTriangles(
+	const uvec2& viewport, 
+	Span<const vec4> transformedVertecies, 
+	Span<const typename FragmentShader::Input> colors, 
+	Span<const std::array<Index, 3>> indices, 
+	FragmentShader& fs,
+	float* depthBuffer, 
+	Color* colorBuffer) {
+	static thread_local std::vector<SetupTriangle<FragmentShader>> triangles;
+	triangles.clear();
+	setupTransformedTriangles(viewport, transformedVertecies, colors, indices, triangles);
+	rasterSetupTriangles(viewport, Span<const SetupTriangle<FragmentShader>>(triangles), fs, depthBuffer, colorBuffer);
+}
+
+template <typename FragmentShader>
+void rasterTriangleIndexed(
+	const uvec2& viewport, 
+	Span<const vec3> vertecies, 
+	Span<const typename FragmentShader::Input> colors, 
+	Span<const std::array<uint32_t, 3>> indices, 
+	const mat4& mvp, 
+	FragmentShader fs,
+	float* depthBuffer, 
+	Color* colorBuffer) {
+	// reused across draws, so steady-state submission does not allocate
+	static thread_local std::vector<vec4> transformedVertecies;
+	transformedVertecies.resize(vertecies.size());
+	transformVertecies(vertecies, mvp, transformedVertecies.data());
+
+	rasterTransformedTriangles(viewport, transformedVertecies, colors, indices, fs, depthBuffer, colorBuffer);
+}
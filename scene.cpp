@@ -0,0 +1,855 @@
+#include "scene.h"
+
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+#include <map>
+#include <stdexcept>
+
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "obj_parser.h"
+#include "parallel.h"
+
+namespace {
+
+constexpr u32 MESH_CACHE_MAGIC = 0x48534D52; // "RMSH"
+constexpr u32 MESH_CACHE_VERSION = 6;
+constexpr size_t SECTION_ALIGNMENT = 16;
+
+// Coarser levels built next to every full mesh, each aiming for half the triangles of the one before
+constexpr u32 MAX_MESH_LODS = 3;
+// Meshes smaller than this are cheap enough to always draw in full
+constexpr u32 MIN_LOD_SOURCE_TRIANGLES = 256;
+// A level is only kept if simplification got it below this fraction of the previous level's triangles
+constexpr float MIN_LOD_REDUCTION = 0.75f;
+// Cells of the chunk grid along the longest side of the scene bounds
+constexpr u32 CHUNK_GRID_CELLS = 8;
+
+enum class MeshCacheSection : u32 {
+	Positions,
+	TexCoords,
+	QuantizedPositions,
+	HalfTexCoords,
+	Indices,
+	ShortIndices,
+	Meshes,
+	Meshlets,
+	MeshletOrders,
+	Lods,
+	Chunks,
+	// texture file of every material slot referenced by Mesh::texture
+	Materials,
+	// .mtl files the OBJ depends on, hashed together with it
+	MaterialLibraries,
+	Count
+};
+
+// Load options that change the cached data
+enum MeshCacheFlags : u32 {
+	OptimizedMeshes = 1 << 0,
+	ChunkedGeometry = 1 << 1,
+	QuantizedVertices = 1 << 2,
+};
+
+struct MeshCacheHeader {
+	u32 magic;
+	u32 version;
+	u64 sourceHash;
+	u32 sectionCount;
+	u32 flags;
+};
+
+struct MeshCacheSectionEntry {
+	u64 offset;
+	u64 size;
+};
+
+static_assert(std::is_trivially_copyable<Mesh>::value, "meshes are stored in the mesh cache as is");
+
+// Open addressing table from an OBJ (position, texcoord) index pair to a mesh-local vertex index
+class VertexHashTable {
+public:
+	explicit VertexHashTable(size_t expectedKeys) {
+		size_t capacity = 16;
+		while (capacity < 2 * expectedKeys) {
+			capacity *= 2;
+		}
+		m_keys.assign(capacity, EMPTY);
+		m_values.resize(capacity);
+		m_mask = capacity - 1;
+	}
+
+	// Returns the index stored for the key, inserting nextValue if the key is new
+	u32 findOrInsert(u64 key, u32 nextValue, bool& inserted) {
+		auto slot = (key * 0x9E3779B97F4A7C15ull >> 32) & m_mask;
+		while (true) {
+			if (m_keys[slot] == key) {
+				inserted = false;
+				return m_values[slot];
+			}
+			if (m_keys[slot] == EMPTY) {
+				m_keys[slot] = key;
+				m_values[slot] = nextValue;
+				inserted = true;
+				return nextValue;
+			}
+			slot = (slot + 1) & m_mask;
+		}
+	}
+
+private:
+	static constexpr u64 EMPTY = ~0ull;
+
+	std::vector<u64> m_keys;
+	std::vector<u32> m_values;
+	size_t m_mask;
+};
+
+// Writes the group's triangles as indices into indices, which has room for one per triangle, and returns the unique
+// (position, texcoord) pairs they index in first use order
+std::vector<ObjCorner> deduplicate(Span<const std::array<ObjCorner, 3>> triangles, Span<std::array<u32, 3>> indices) {
+	std::vector<ObjCorner> ret;
+	VertexHashTable table(triangles.size() * 3);
+	for (size_t t = 0; t < triangles.size(); ++t) {
+		for (size_t i = 0; i < 3; ++i) {
+			const auto& corner = triangles[t][i];
+			auto key = (u64(corner.position) << 32) | corner.texCoord;
+			bool inserted;
+			auto index = table.findOrInsert(key, u32(ret.size()), inserted);
+			if (inserted) {
+				ret.push_back(corner);
+			}
+			indices[t][i] = index;
+		}
+	}
+
+	return ret;
+}
+
+// Geometry as produced by parsing, before it is laid out in the mesh cache.
+// Mesh::texture holds an index into textureNames until the scene is loaded.
+struct SceneData {
+	std::vector<vec3> vertecies;
+	std::vector<vec2> texCoords;
+	std::vector<QuantizedPosition> quantizedVertecies;
+	std::vector<HalfTexCoord> halfTexCoords;
+	std::vector<std::array<u32, 3>> indices;
+	std::vector<ShortTriangle> shortIndices;
+	std::vector<Mesh> meshes;
+	std::vector<Meshlet> meshlets;
+	std::vector<u32> meshletOrders;
+	std::vector<MeshLod> lods;
+	std::vector<GeometryChunk> chunks;
+	std::vector<std::string> textureNames;
+};
+
+// Maps every group's material to a slot in textureNames, materials sharing a texture file share a slot
+std::vector<u32> collectTextures(
+	const std::vector<ObjGroup>& groups, 
+	const std::map<std::string, std::string>& materialTextures, 
+	std::vector<std::string>& textureNames) {
+	std::map<std::string, u32> slotsByName;
+	std::vector<u32> ret;
+	ret.reserve(groups.size());
+	for (const auto& group : groups) {
+		auto material = materialTextures.find(group.material);
+		if (material == materialTextures.end()) {
+			std::cerr << "Unknown material '" << group.material << "'" << std::endl;
+			throw std::runtime_error("shape without material");
+		}
+
+		const auto& name = material->second;
+		if (name.empty()) {
+			std::cerr << "Missing texture file" << std::endl;
+			throw std::runtime_error("no tex file");
+		}
+
+		auto found = slotsByName.find(name);
+		if (found != slotsByName.end()) {
+			ret.push_back(found->second);
+			continue;
+		}
+
+		auto slot = u32(textureNames.size());
+		textureNames.push_back(name);
+		slotsByName[name] = slot;
+		ret.push_back(slot);
+	}
+
+	return ret;
+}
+
+// Materials of all the libraries, later libraries overriding earlier ones
+std::map<std::string, std::string> loadMaterialTextures(const std::vector<std::string>& libraries) {
+	std::map<std::string, std::string> ret;
+	for (const auto& library : libraries) {
+		auto file = MappedFile::openIfExists("../resources/" + library);
+		if (!file.isOpen()) {
+			std::cerr << "Material library " << library << " not found" << std::endl;
+			continue;
+		}
+		for (auto& material : parseMaterialTextures(file)) {
+			ret[material.first] = std::move(material.second);
+		}
+	}
+	return ret;
+}
+
+SceneData parseScene(const MappedFile& obj, std::vector<std::string>& libraries) {
+	auto parseStart = std::chrono::steady_clock::now();
+	auto parsed = parseObj(obj);
+	libraries = parsed.materialLibraries;
+
+	SceneData ret;
+	auto groupTextures = collectTextures(parsed.groups, loadMaterialTextures(libraries), ret.textureNames);
+
+	// groups are laid out in file order, which keeps the streams independent of the thread schedule. A group has one
+	// index per triangle, so the index stream is laid out up front and deduplication writes straight into it.
+	std::vector<u32> baseIndices(parsed.groups.size());
+	size_t indexCount = 0;
+	for (size_t i = 0; i < parsed.groups.size(); ++i) {
+		baseIndices[i] = u32(indexCount);
+		indexCount += parsed.groups[i].triangleCount;
+	}
+	ret.indices.resize(indexCount);
+
+	std::vector<std::vector<ObjCorner>> groupVertecies(parsed.groups.size());
+	parallelFor(parsed.groups.size(), [&](size_t i) {
+		const auto& group = parsed.groups[i];
+		groupVertecies[i] = deduplicate(
+			Span<const std::array<ObjCorner, 3>>(parsed.triangles.data() + group.baseTriangle, group.triangleCount),
+			Span<std::array<u32, 3>>(ret.indices.data() + baseIndices[i], group.triangleCount));
+	});
+
+	size_t vertexCount = 0;
+	for (size_t i = 0; i < parsed.groups.size(); ++i) {
+		ret.meshes.push_back({
+			baseIndices[i], parsed.groups[i].triangleCount, 
+			u32(vertexCount), u32(groupVertecies[i].size()), 
+			groupTextures[i], 
+			0, 0, 0, 0, vec3(0.0f), 0.0f, 
+			vec3(0.0f), vec3(1.0f), false});
+		vertexCount += groupVertecies[i].size();
+	}
+	ret.vertecies.resize(vertexCount);
+	ret.texCoords.resize(vertexCount);
+
+	parallelFor(parsed.groups.size(), [&](size_t i) {
+		const auto& mesh = ret.meshes[i];
+		const auto& corners = groupVertecies[i];
+		for (size_t v = 0; v < corners.size(); ++v) {
+			ret.vertecies[mesh.baseVertex + v] = parsed.positions[corners[v].position];
+			ret.texCoords[mesh.baseVertex + v] = parsed.texCoords[corners[v].texCoord];
+		}
+	});
+
+	auto parseTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - parseStart);
+	std::cout << "Parsed " << parsed.positions.size() << " positions and " << parsed.triangles.size() 
+		<< " triangles in " << parseTime.count() << "ms" << std::endl;
+
+	return ret;
+}
+
+// Appends a chunk of the meshes [baseMesh, baseMesh + meshCount), bounding the vertices they span
+void addChunk(SceneData& data, u32 baseMesh, u32 meshCount) {
+	const auto& first = data.meshes[baseMesh];
+	const auto& last = data.meshes[baseMesh + meshCount - 1];
+	auto bounds = boundingSphere(Span<const vec3>(
+		data.vertecies.data() + first.baseVertex, last.baseVertex + last.vertexCount - first.baseVertex));
+	data.chunks.push_back({bounds.center, bounds.radius, baseMesh, meshCount});
+}
+
+// Cuts every mesh along a uniform grid over the scene bounds, assigning triangles by their centroid, and lays the
+// pieces out cell by cell so every non-empty cell becomes a chunk
+void splitIntoChunks(SceneData& data) {
+	if (data.vertecies.empty()) {
+		return;
+	}
+
+	auto lo = data.vertecies[0];
+	auto hi = data.vertecies[0];
+	for (const auto& position : data.vertecies) {
+		lo = glm::min(lo, position);
+		hi = glm::max(hi, position);
+	}
+	auto extent = hi - lo;
+	auto cellSize = std::max(std::max(extent.x, extent.y), extent.z) / CHUNK_GRID_CELLS;
+	cellSize = cellSize > 0.0f ? cellSize : 1.0f;
+	auto cells = glm::uvec3(extent / cellSize) + 1u;
+	auto cellOf = [&](const vec3& position) {
+		auto cell = glm::min(glm::uvec3((position - lo) / cellSize), cells - 1u);
+		return (cell.z * cells.y + cell.y) * cells.x + cell.x;
+	};
+
+	struct Piece {
+		u32 cell;
+		u32 mesh;
+		std::vector<u32> triangles;
+	};
+	std::vector<Piece> pieces;
+	for (u32 m = 0; m < data.meshes.size(); ++m) {
+		const auto& mesh = data.meshes[m];
+		std::map<u32, std::vector<u32>> trianglesByCell;
+		for (auto t = mesh.baseIndex; t < mesh.baseIndex + mesh.indexCount; ++t) {
+			auto centroid = vec3(0.0f);
+			for (auto v : data.indices[t]) {
+				centroid += data.vertecies[mesh.baseVertex + v] / 3.0f;
+			}
+			trianglesByCell[cellOf(centroid)].push_back(t);
+		}
+		for (auto& cell : trianglesByCell) {
+			pieces.push_back({cell.first, m, std::move(cell.second)});
+		}
+	}
+	std::stable_sort(pieces.begin(), pieces.end(), [](const Piece& a, const Piece& b) {
+		return a.cell < b.cell;
+	});
+
+	constexpr u32 UNASSIGNED = ~0u;
+	SceneData split;
+	split.textureNames = std::move(data.textureNames);
+	std::vector<u32> remap;
+	std::vector<u32> chunkStarts;
+	for (size_t i = 0; i < pieces.size(); ++i) {
+		const auto& piece = pieces[i];
+		const auto& source = data.meshes[piece.mesh];
+		if (i == 0 || pieces[i - 1].cell != piece.cell) {
+			chunkStarts.push_back(u32(split.meshes.size()));
+		}
+
+		auto mesh = source;
+		mesh.baseIndex = u32(split.indices.size());
+		mesh.indexCount = u32(piece.triangles.size());
+		mesh.baseVertex = u32(split.vertecies.size());
+		remap.assign(source.vertexCount, UNASSIGNED);
+		for (auto t : piece.triangles) {
+			std::array<u32, 3> tri;
+			for (size_t corner = 0; corner < 3; ++corner) {
+				auto v = data.indices[t][corner];
+				if (remap[v] == UNASSIGNED) {
+					remap[v] = u32(split.vertecies.size()) - mesh.baseVertex;
+					split.vertecies.push_back(data.vertecies[source.baseVertex + v]);
+					split.texCoords.push_back(data.texCoords[source.baseVertex + v]);
+				}
+				tri[corner] = remap[v];
+			}
+			split.indices.push_back(tri);
+		}
+		mesh.vertexCount = u32(split.vertecies.size()) - mesh.baseVertex;
+		split.meshes.push_back(mesh);
+	}
+	chunkStarts.push_back(u32(split.meshes.size()));
+
+	data = std::move(split);
+	for (size_t i = 0; i + 1 < chunkStarts.size(); ++i) {
+		addChunk(data, chunkStarts[i], chunkStarts[i + 1] - chunkStarts[i]);
+	}
+}
+
+template <typename T>
+void reorderRange(std::vector<T>& stream, u32 base, const std::vector<u32>& remap) {
+	std::vector<T> original(stream.begin() + base, stream.begin() + base + remap.size());
+	for (size_t i = 0; i < remap.size(); ++i) {
+		stream[base + remap[i]] = original[i];
+	}
+}
+
+// The rasterizer transforms every referenced vertex once per draw and keeps no post-transform cache, so the ACMR is
+// only a reference for hardware style pipelines. The overfetch of the position and texture coordinate streams is what
+// the transform and the triangle setup actually pay for.
+struct MeshEfficiency {
+	float acmr = 0;
+	float positionOverfetch = 0;
+	float texCoordOverfetch = 0;
+};
+
+// Triangle weighted average over all full meshes
+MeshEfficiency measureEfficiency(const SceneData& data) {
+	MeshEfficiency ret;
+	size_t triangleCount = 0;
+	for (const auto& mesh : data.meshes) {
+		Span<const std::array<u32, 3>> indices(data.indices.data() + mesh.baseIndex, mesh.indexCount);
+		ret.acmr += averageCacheMissRatio(indices, mesh.vertexCount) * mesh.indexCount;
+		ret.positionOverfetch += vertexFetchOverfetch(indices, mesh.vertexCount, sizeof(vec3)) * mesh.indexCount;
+		ret.texCoordOverfetch += vertexFetchOverfetch(indices, mesh.vertexCount, sizeof(vec2)) * mesh.indexCount;
+		triangleCount += mesh.indexCount;
+	}
+
+	triangleCount = std::max<size_t>(triangleCount, 1);
+	ret.acmr /= triangleCount;
+	ret.positionOverfetch /= triangleCount;
+	ret.texCoordOverfetch /= triangleCount;
+	return ret;
+}
+
+std::ostream& operator<<(std::ostream& os, const MeshEfficiency& efficiency) {
+	return os << "ACMR " << efficiency.acmr 
+		<< ", position overfetch " << efficiency.positionOverfetch 
+		<< ", texcoord overfetch " << efficiency.texCoordOverfetch;
+}
+
+// Reorders the triangles within every meshlet for vertex cache reuse, leaving the meshlets themselves as clustered.
+// The vertices are renumbered local to the meshlet first, so the cost does not grow with the size of the mesh.
+void optimizeMeshletVertexCache(Span<std::array<u32, 3>> indices, u32 vertexCount, const std::vector<u32>& meshletSizes) {
+	constexpr u32 NO_VERTEX = ~0u;
+	std::vector<u32> localVertex(vertexCount, NO_VERTEX);
+	std::vector<u32> meshletVertecies;
+	u32 baseIndex = 0;
+	for (auto meshletSize : meshletSizes) {
+		Span<std::array<u32, 3>> meshlet(indices.data() + baseIndex, meshletSize);
+		meshletVertecies.clear();
+		for (auto& tri : meshlet) {
+			for (auto& v : tri) {
+				if (localVertex[v] == NO_VERTEX) {
+					localVertex[v] = u32(meshletVertecies.size());
+					meshletVertecies.push_back(v);
+				}
+				v = localVertex[v];
+			}
+		}
+
+		optimizeVertexCache(meshlet, u32(meshletVertecies.size()));
+
+		for (auto& tri : meshlet) {
+			for (auto& v : tri) {
+				v = meshletVertecies[v];
+			}
+		}
+		for (auto v : meshletVertecies) {
+			localVertex[v] = NO_VERTEX;
+		}
+		baseIndex += meshletSize;
+	}
+}
+
+// Splits every mesh into meshlets, optionally reorders the triangles of each meshlet for vertex cache reuse, then
+// renumbers its vertices in the final triangle order so the vertices of a meshlet are mostly adjacent in memory.
+// The meshlets are also ordered front to back for each of the precomputed directions.
+void buildMeshlets(SceneData& data, bool optimize) {
+	std::vector<std::vector<Meshlet>> meshMeshlets(data.meshes.size());
+	std::vector<std::vector<u32>> meshOrders(data.meshes.size());
+	parallelFor(data.meshes.size(), [&](size_t i) {
+		auto& mesh = data.meshes[i];
+		Span<std::array<u32, 3>> indices(data.indices.data() + mesh.baseIndex, mesh.indexCount);
+		auto meshletSizes = clusterTriangles(indices, mesh.vertexCount);
+		if (optimize) {
+			optimizeMeshletVertexCache(indices, mesh.vertexCount, meshletSizes);
+		}
+		auto remap = optimizeVertexFetch(indices, mesh.vertexCount);
+		reorderRange(data.vertecies, mesh.baseVertex, remap);
+		reorderRange(data.texCoords, mesh.baseVertex, remap);
+
+		Span<const vec3> positions(data.vertecies.data() + mesh.baseVertex, mesh.vertexCount);
+		u32 baseIndex = 0;
+		for (auto meshletSize : meshletSizes) {
+			meshMeshlets[i].push_back(buildMeshlet(indices, baseIndex, meshletSize, positions));
+			baseIndex += meshletSize;
+		}
+
+		for (u32 direction = 0; direction < MESHLET_ORDER_DIRECTIONS; ++direction) {
+			auto order = orderMeshlets(meshMeshlets[i], meshletOrderDirection(direction));
+			meshOrders[i].insert(meshOrders[i].end(), order.begin(), order.end());
+		}
+
+		auto bounds = boundingSphere(positions);
+		mesh.center = bounds.center;
+		mesh.radius = bounds.radius;
+	});
+
+	for (size_t i = 0; i < data.meshes.size(); ++i) {
+		data.meshes[i].baseMeshlet = u32(data.meshlets.size());
+		data.meshes[i].meshletCount = u32(meshMeshlets[i].size());
+		data.meshlets.insert(data.meshlets.end(), meshMeshlets[i].begin(), meshMeshlets[i].end());
+		data.meshletOrders.insert(data.meshletOrders.end(), meshOrders[i].begin(), meshOrders[i].end());
+	}
+}
+
+// Simplifies every mesh into a chain of coarser levels, appending their indices after the full meshes. Every level
+// is simplified from the full mesh, so its error is measured against the surface that is actually replaced.
+void buildLods(SceneData& data, bool optimize) {
+	auto lodStart = std::chrono::steady_clock::now();
+	std::vector<std::vector<std::vector<std::array<u32, 3>>>> meshLods(data.meshes.size());
+	std::vector<std::vector<float>> meshLodErrors(data.meshes.size());
+	parallelFor(data.meshes.size(), [&](size_t i) {
+		const auto& mesh = data.meshes[i];
+		Span<const std::array<u32, 3>> indices(data.indices.data() + mesh.baseIndex, mesh.indexCount);
+		Span<const vec3> positions(data.vertecies.data() + mesh.baseVertex, mesh.vertexCount);
+
+		auto previousCount = mesh.indexCount;
+		while (meshLods[i].size() < MAX_MESH_LODS && previousCount >= MIN_LOD_SOURCE_TRIANGLES) {
+			float error;
+			auto lod = simplifyMesh(indices, positions, previousCount / 2, error);
+			if (lod.empty() || lod.size() > previousCount * MIN_LOD_REDUCTION) {
+				break;
+			}
+
+			if (optimize) {
+				optimizeVertexCache(lod, mesh.vertexCount);
+			}
+			previousCount = u32(lod.size());
+			meshLods[i].push_back(std::move(lod));
+			meshLodErrors[i].push_back(error);
+		}
+	});
+
+	size_t lodTriangles = 0;
+	for (size_t i = 0; i < data.meshes.size(); ++i) {
+		auto& mesh = data.meshes[i];
+		mesh.baseLod = u32(data.lods.size());
+		mesh.lodCount = u32(meshLods[i].size());
+		for (size_t level = 0; level < meshLods[i].size(); ++level) {
+			const auto& lod = meshLods[i][level];
+			data.lods.push_back({u32(data.indices.size()), u32(lod.size()), meshLodErrors[i][level]});
+			data.indices.insert(data.indices.end(), lod.begin(), lod.end());
+			lodTriangles += lod.size();
+		}
+	}
+
+	auto lodTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lodStart);
+	std::cout << "Built " << data.lods.size() << " levels of detail with " << lodTriangles << " triangles in " 
+		<< lodTime.count() << "ms" << std::endl;
+}
+
+// Replaces the full precision vertex streams with positions quantized within every mesh's bounds and half float
+// texture coordinates, and moves the indices of meshes with at most 64K vertices to 16 bits. The full meshes are
+// laid out before the levels of detail in both index streams, as in the full precision one.
+void quantizeVertices(SceneData& data) {
+	constexpr float QUANTIZED_MAX = 65535.0f;
+
+	data.quantizedVertecies.resize(data.vertecies.size());
+	data.halfTexCoords.resize(data.texCoords.size());
+	parallelFor(data.meshes.size(), [&](size_t i) {
+		auto& mesh = data.meshes[i];
+		if (mesh.vertexCount == 0) {
+			return;
+		}
+
+		auto lo = data.vertecies[mesh.baseVertex];
+		auto hi = lo;
+		for (auto v = mesh.baseVertex; v < mesh.baseVertex + mesh.vertexCount; ++v) {
+			lo = glm::min(lo, data.vertecies[v]);
+			hi = glm::max(hi, data.vertecies[v]);
+		}
+		mesh.decodeOffset = lo;
+		mesh.decodeScale = (hi - lo) / QUANTIZED_MAX;
+		// flat axes quantize to 0 and decode to the offset
+		auto encodeScale = vec3(0.0f);
+		for (int axis = 0; axis < 3; ++axis) {
+			encodeScale[axis] = mesh.decodeScale[axis] > 0.0f ? 1.0f / mesh.decodeScale[axis] : 0.0f;
+		}
+
+		for (auto v = mesh.baseVertex; v < mesh.baseVertex + mesh.vertexCount; ++v) {
+			auto quantized = glm::clamp(glm::round((data.vertecies[v] - lo) * encodeScale), vec3(0.0f), vec3(QUANTIZED_MAX));
+			data.quantizedVertecies[v] = {u16(quantized.x), u16(quantized.y), u16(quantized.z)};
+			data.halfTexCoords[v] = glm::packHalf2x16(data.texCoords[v]);
+		}
+	});
+
+	std::vector<std::array<u32, 3>> indices;
+	auto relocate = [&](bool shortIndices, u32& baseIndex, u32 indexCount) {
+		auto source = data.indices.begin() + baseIndex;
+		if (shortIndices) {
+			baseIndex = u32(data.shortIndices.size());
+			for (auto tri = source; tri != source + indexCount; ++tri) {
+				data.shortIndices.push_back({u16((*tri)[0]), u16((*tri)[1]), u16((*tri)[2])});
+			}
+		} else {
+			baseIndex = u32(indices.size());
+			indices.insert(indices.end(), source, source + indexCount);
+		}
+	};
+	for (auto& mesh : data.meshes) {
+		mesh.shortIndices = mesh.vertexCount <= 0x10000;
+		relocate(mesh.shortIndices, mesh.baseIndex, mesh.indexCount);
+	}
+	for (const auto& mesh : data.meshes) {
+		for (auto& lod : Span<MeshLod>(data.lods.data() + mesh.baseLod, mesh.lodCount)) {
+			relocate(mesh.shortIndices, lod.baseIndex, lod.indexCount);
+		}
+	}
+
+	data.indices = std::move(indices);
+	data.vertecies = {};
+	data.texCoords = {};
+}
+
+u64 hashMaterialLibraries(u64 objHash, const std::vector<std::string>& libraries) {
+	auto ret = objHash;
+	for (const auto& library : libraries) {
+		auto file = MappedFile::openIfExists("../resources/" + library);
+		ret = file.isOpen() ? contentHash(file.data(), file.size(), ret) : contentHash(nullptr, 0, ret);
+	}
+	return ret;
+}
+
+std::vector<u8> serializeStrings(const std::vector<std::string>& strings) {
+	std::vector<u8> ret;
+	for (const auto& str : strings) {
+		auto length = u32(str.size());
+		ret.insert(ret.end(), reinterpret_cast<const u8*>(&length), reinterpret_cast<const u8*>(&length + 1));
+		ret.insert(ret.end(), str.begin(), str.end());
+	}
+	return ret;
+}
+
+bool deserializeStrings(const u8* data, size_t size, std::vector<std::string>& strings) {
+	size_t offset = 0;
+	while (offset < size) {
+		u32 length;
+		if (offset + sizeof(length) > size) {
+			return false;
+		}
+		std::memcpy(&length, data + offset, sizeof(length));
+		offset += sizeof(length);
+		if (offset + length > size) {
+			return false;
+		}
+		strings.emplace_back(reinterpret_cast<const char*>(data + offset), length);
+		offset += length;
+	}
+	return true;
+}
+
+template <typename T>
+std::pair<const u8*, size_t> sectionOf(const std::vector<T>& data) {
+	return {reinterpret_cast<const u8*>(data.data()), data.size() * sizeof(T)};
+}
+
+std::vector<u8> buildMeshCache(const SceneData& data, u64 sourceHash, u32 flags, const std::vector<std::string>& libraries) {
+	auto materials = serializeStrings(data.textureNames);
+	auto libraryNames = serializeStrings(libraries);
+
+	std::array<std::pair<const u8*, size_t>, size_t(MeshCacheSection::Count)> sections;
+	sections[size_t(MeshCacheSection::Positions)] = sectionOf(data.vertecies);
+	sections[size_t(MeshCacheSection::TexCoords)] = sectionOf(data.texCoords);
+	sections[size_t(MeshCacheSection::QuantizedPositions)] = sectionOf(data.quantizedVertecies);
+	sections[size_t(MeshCacheSection::HalfTexCoords)] = sectionOf(data.halfTexCoords);
+	sections[size_t(MeshCacheSection::Indices)] = sectionOf(data.indices);
+	sections[size_t(MeshCacheSection::ShortIndices)] = sectionOf(data.shortIndices);
+	sections[size_t(MeshCacheSection::Meshes)] = sectionOf(data.meshes);
+	sections[size_t(MeshCacheSection::Meshlets)] = sectionOf(data.meshlets);
+	sections[size_t(MeshCacheSection::MeshletOrders)] = sectionOf(data.meshletOrders);
+	sections[size_t(MeshCacheSection::Lods)] = sectionOf(data.lods);
+	sections[size_t(MeshCacheSection::Chunks)] = sectionOf(data.chunks);
+	sections[size_t(MeshCacheSection::Materials)] = sectionOf(materials);
+	sections[size_t(MeshCacheSection::MaterialLibraries)] = sectionOf(libraryNames);
+
+	std::vector<MeshCacheSectionEntry> entries;
+	auto offset = sizeof(MeshCacheHeader) + sections.size() * sizeof(MeshCacheSectionEntry);
+	for (const auto& section : sections) {
+		offset = (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+		entries.push_back({offset, section.second});
+		offset += section.second;
+	}
+
+	std::vector<u8> ret(offset, 0);
+	MeshCacheHeader header{MESH_CACHE_MAGIC, MESH_CACHE_VERSION, sourceHash, u32(sections.size()), flags};
+	std::memcpy(ret.data(), &header, sizeof(header));
+	std::memcpy(ret.data() + sizeof(header), entries.data(), entries.size() * sizeof(MeshCacheSectionEntry));
+	for (size_t i = 0; i < sections.size(); ++i) {
+		if (sections[i].second > 0) {
+			std::memcpy(ret.data() + entries[i].offset, sections[i].first, sections[i].second);
+		}
+	}
+
+	return ret;
+}
+
+template <typename T>
+bool readSection(const u8* data, const MeshCacheSectionEntry& entry, Span<const T>& out) {
+	if (entry.size % sizeof(T) != 0 || entry.offset % alignof(T) != 0) {
+		return false;
+	}
+	out = Span<const T>(reinterpret_cast<const T*>(data + entry.offset), entry.size / sizeof(T));
+	return true;
+}
+
+// Points the scene's streams into the cache and reads its tables. Returns false if the cache is stale or corrupt.
+bool readMeshCache(
+	const u8* data, size_t size, 
+	u64 objHash, u32 flags, 
+	Scene& scene, std::vector<std::string>& textureNames) {
+	MeshCacheHeader header;
+	auto tableEnd = sizeof(header) + size_t(MeshCacheSection::Count) * sizeof(MeshCacheSectionEntry);
+	if (size < tableEnd) {
+		return false;
+	}
+
+	std::memcpy(&header, data, sizeof(header));
+	if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION 
+		|| header.sectionCount != u32(MeshCacheSection::Count) || header.flags != flags) {
+		return false;
+	}
+
+	std::array<MeshCacheSectionEntry, size_t(MeshCacheSection::Count)> entries;
+	std::memcpy(entries.data(), data + sizeof(header), entries.size() * sizeof(MeshCacheSectionEntry));
+	for (const auto& entry : entries) {
+		if (entry.offset < tableEnd || entry.offset > size || entry.size > size - entry.offset) {
+			return false;
+		}
+	}
+
+	std::vector<std::string> libraries;
+	const auto& librariesEntry = entries[size_t(MeshCacheSection::MaterialLibraries)];
+	if (!deserializeStrings(data + librariesEntry.offset, librariesEntry.size, libraries)
+		|| hashMaterialLibraries(objHash, libraries) != header.sourceHash) {
+		return false;
+	}
+
+	Span<const Mesh> meshes;
+	const auto& materialsEntry = entries[size_t(MeshCacheSection::Materials)];
+	if (!readSection(data, entries[size_t(MeshCacheSection::Positions)], scene.vertecies)
+		|| !readSection(data, entries[size_t(MeshCacheSection::TexCoords)], scene.texCoords)
+		|| !readSection(data, entries[size_t(MeshCacheSection::QuantizedPositions)], scene.quantizedVertecies)
+		|| !readSection(data, entries[size_t(MeshCacheSection::HalfTexCoords)], scene.halfTexCoords)
+		|| !readSection(data, entries[size_t(MeshCacheSection::Indices)], scene.indices)
+		|| !readSection(data, entries[size_t(MeshCacheSection::ShortIndices)], scene.shortIndices)
+		|| !readSection(data, entries[size_t(MeshCacheSection::Meshes)], meshes)
+		|| !readSection(data, entries[size_t(MeshCacheSection::Meshlets)], scene.meshlets)
+		|| !readSection(data, entries[size_t(MeshCacheSection::MeshletOrders)], scene.meshletOrders)
+		|| !readSection(data, entries[size_t(MeshCacheSection::Lods)], scene.lods)
+		|| !readSection(data, entries[size_t(MeshCacheSection::Chunks)], scene.chunks)
+		|| !deserializeStrings(data + materialsEntry.offset, materialsEntry.size, textureNames)
+		|| scene.vertecies.size() != scene.texCoords.size()
+		|| scene.quantizedVertecies.size() != scene.halfTexCoords.size()
+		|| scene.meshletOrders.size() != scene.meshlets.size() * MESHLET_ORDER_DIRECTIONS) {
+		return false;
+	}
+	scene.quantized = flags & QuantizedVertices;
+
+	for (const auto& mesh : meshes) {
+		auto indexCount = mesh.shortIndices ? scene.shortIndices.size() : scene.indices.size();
+		if (u64(mesh.baseIndex) + mesh.indexCount > indexCount
+			|| u64(mesh.baseVertex) + mesh.vertexCount > scene.vertexCount()
+			|| (mesh.shortIndices && mesh.vertexCount > 0x10000)
+			|| mesh.texture >= textureNames.size()
+			|| u64(mesh.baseMeshlet) + mesh.meshletCount > scene.meshlets.size()
+			|| u64(mesh.baseLod) + mesh.lodCount > scene.lods.size()) {
+			return false;
+		}
+
+		for (const auto& lod : scene.lods.subspan(mesh.baseLod, mesh.lodCount)) {
+			if (u64(lod.baseIndex) + lod.indexCount > indexCount) {
+				return false;
+			}
+		}
+
+		for (const auto& meshlet : scene.meshlets.subspan(mesh.baseMeshlet, mesh.meshletCount)) {
+			if (u64(meshlet.baseIndex) + meshlet.indexCount > mesh.indexCount) {
+				return false;
+			}
+		}
+
+		auto orders = scene.meshletOrders.subspan(
+			size_t(mesh.baseMeshlet) * MESHLET_ORDER_DIRECTIONS, size_t(mesh.meshletCount) * MESHLET_ORDER_DIRECTIONS);
+		for (auto meshlet : orders) {
+			if (meshlet >= mesh.meshletCount) {
+				return false;
+			}
+		}
+	}
+	for (const auto& chunk : scene.chunks) {
+		if (chunk.meshCount == 0 || u64(chunk.baseMesh) + chunk.meshCount > meshes.size()) {
+			return false;
+		}
+	}
+	scene.meshes.assign(meshes.begin(), meshes.end());
+
+	return true;
+}
+
+}
+
+void loadScene(const std::string& sceneFileName, const Options& options, Scene& scene, TextureTable& textures) {
+	auto loadStart = std::chrono::steady_clock::now();
+	auto objPath = "../resources/" + sceneFileName;
+	auto cachePath = objPath + ".rmesh";
+	MappedFile obj(objPath);
+	auto objHash = contentHash(obj.data(), obj.size());
+	u32 flags = 0;
+	if (options.optimizeMeshes) {
+		flags |= OptimizedMeshes;
+	}
+	if (options.geometryBudget > 0) {
+		flags |= ChunkedGeometry;
+	}
+	if (options.quantizedVertices) {
+		flags |= QuantizedVertices;
+	}
+
+	std::vector<std::string> textureNames;
+	scene.mapping = MappedFile::openIfExists(cachePath);
+	auto cached = scene.mapping.isOpen() 
+		&& readMeshCache(scene.mapping.data(), scene.mapping.size(), objHash, flags, scene, textureNames);
+
+	if (!cached) {
+		std::vector<std::string> libraries;
+		auto data = parseScene(obj, libraries);
+		if (flags & ChunkedGeometry) {
+			splitIntoChunks(data);
+		} else if (!data.meshes.empty()) {
+			addChunk(data, 0, u32(data.meshes.size()));
+		}
+		auto optimize = (flags & OptimizedMeshes) != 0;
+		MeshEfficiency before;
+		if (optimize) {
+			before = measureEfficiency(data);
+		}
+		auto meshletStart = std::chrono::steady_clock::now();
+		buildMeshlets(data, optimize);
+		if (optimize) {
+			// measured on the final index buffer, after clustering and renumbering
+			auto after = measureEfficiency(data);
+			auto meshletTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - meshletStart);
+			std::cout << "Optimized " << data.meshes.size() << " meshes in " << meshletTime.count() << "ms" << std::endl;
+			std::cout << "\tbefore: " << before << std::endl;
+			std::cout << "\tafter:  " << after << std::endl;
+		}
+		buildLods(data, optimize);
+		if (flags & QuantizedVertices) {
+			quantizeVertices(data);
+		}
+		auto cache = buildMeshCache(data, hashMaterialLibraries(objHash, libraries), flags, libraries);
+		textureNames.clear();
+		try {
+			writeFileAtomically(cachePath, cache);
+			std::cout << "Rebuilt mesh cache " << cachePath << std::endl;
+			scene.mapping = MappedFile(cachePath);
+			cached = readMeshCache(scene.mapping.data(), scene.mapping.size(), objHash, flags, scene, textureNames);
+		} catch (const std::runtime_error&) {
+			std::cerr << "Mesh cache unavailable, keeping " << objPath << " in memory" << std::endl;
+			scene.mapping = MappedFile();
+			scene.ownedData = std::move(cache);
+			cached = readMeshCache(scene.ownedData.data(), scene.ownedData.size(), objHash, flags, scene, textureNames);
+		}
+
+		if (!cached) {
+			std::cerr << "Mesh cache is corrupt: " << cachePath << std::endl;
+			throw std::runtime_error("mesh cache corrupt");
+		}
+	}
+
+	std::vector<TextureHandle> handles;
+	for (const auto& name : textureNames) {
+		handles.push_back(textures.add("../resources/" + name));
+	}
+	for (auto& mesh : scene.meshes) {
+		mesh.texture = handles[mesh.texture];
+	}
+	auto loadTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - loadStart);
+
+	size_t triangleCount = 0;
+	for (const auto& mesh : scene.meshes) {
+		triangleCount += mesh.indexCount;
+	}
+	auto geometryBytes = scene.vertecies.size() * sizeof(vec3) + scene.texCoords.size() * sizeof(vec2) 
+		+ scene.quantizedVertecies.size() * sizeof(QuantizedPosition) + scene.halfTexCoords.size() * sizeof(HalfTexCoord)
+		+ scene.indices.size() * sizeof(scene.indices[0]) + scene.shortIndices.size() * sizeof(ShortTriangle);
+	std::cout << "Loaded " << scene.vertexCount() << " vertices and " << triangleCount << " triangles in "
+		<< scene.meshes.size() << " meshes (" << scene.meshlets.size() << " meshlets, " << scene.chunks.size() << " chunks) in " 
+		<< loadTime.count() << "ms, " << geometryBytes / 1024 << "KB of vertices and indices" << std::endl;
+
+	if (!textures.isLazy()) {
+		textures.loadAll();
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "predef.h"
+
+#include <string>
+
+#include "mapped_file.h"
+#include "meshlet.h"
+#include "options.h"
+#include "texture.h"
+#include "TypeUtil.h"
+
+// Position quantized to 16 bits per axis within the bounds of its mesh, see Mesh::decodeOffset
+using QuantizedPosition = std::array<u16, 3>;
+// Texture coordinate packed into two half floats, as by glm::packHalf2x16
+using HalfTexCoord = u32;
+using ShortTriangle = std::array<u16, 3>;
+
+// A simplified version of a mesh. Its indices are relative to the mesh's baseVertex like the mesh's own. error
+// estimates in model space how far the simplified surface strays from the full one: it is the root of the largest
+// area weighted mean squared distance of a collapse, an RMS value rather than a bound on the largest distance.
+struct MeshLod {
+	u32 baseIndex;
+	u32 indexCount;
+	float error;
+};
+
+// Triangles sharing one material. A mesh owns a contiguous range of the vertex streams and its indices are
+// relative to baseVertex, so a draw only has to transform the mesh's own vertices.
+// Its triangles are partitioned into the meshlets [baseMeshlet, baseMeshlet + meshletCount), and the levels of detail
+// [baseLod, baseLod + lodCount) are progressively coarser versions of them.
+struct Mesh {
+	u32 baseIndex;
+	u32 indexCount;
+	u32 baseVertex;
+	u32 vertexCount;
+	TextureHandle texture;
+	u32 baseMeshlet;
+	u32 meshletCount;
+	u32 baseLod;
+	u32 lodCount;
+	vec3 center;
+	float radius;
+	// quantized model space position = decodeOffset + decodeScale * quantized position
+	vec3 decodeOffset;
+	vec3 decodeScale;
+	// the mesh's indices, including its levels of detail, are in Scene::shortIndices instead of Scene::indices
+	bool shortIndices;
+};
+
+// A spatially coherent run of meshes, [baseMesh, baseMesh + meshCount), whose data is contiguous in every stream so it
+// can be paged in and out of memory as a whole
+struct GeometryChunk {
+	vec3 center;
+	float radius;
+	u32 baseMesh;
+	u32 meshCount;
+};
+
+// Geometry of a loaded scene. The streams point into the memory mapped mesh cache, or into ownedData when the
+// cache could not be written, and are used in place.
+// A quantized scene keeps its vertices in the compact streams and leaves the full precision ones empty.
+struct Scene {
+	Span<const vec3> vertecies;
+	Span<const vec2> texCoords;
+	Span<const QuantizedPosition> quantizedVertecies;
+	Span<const HalfTexCoord> halfTexCoords;
+	Span<const std::array<u32, 3>> indices;
+	Span<const ShortTriangle> shortIndices;
+	Span<const Meshlet> meshlets;
+	// for every mesh, MESHLET_ORDER_DIRECTIONS front to back orders of its meshlets starting at
+	// baseMeshlet * MESHLET_ORDER_DIRECTIONS, one after the other and relative to baseMeshlet
+	Span<const u32> meshletOrders;
+	Span<const MeshLod> lods;
+	Span<const GeometryChunk> chunks;
+	std::vector<Mesh> meshes;
+	bool quantized = false;
+
+	size_t vertexCount() const { return quantized ? quantizedVertecies.size() : vertecies.size(); }
+
+	MappedFile mapping;
+	std::vector<u8> ownedData;
+};
+
+// Loads an OBJ file from the resources directory through its binary cache ("<file>.rmesh"), registering the
+// scene's textures in the texture table. The cache holds the deduplicated vertex streams, the index buffer and the
+// mesh and material tables, and is rebuilt whenever the OBJ file or one of its material libraries changes.
+// Every OBJ shape becomes one mesh, with (position, texcoord) pairs deduplicated within the shape. Meshes are split
+// into meshlets and their vertices numbered in meshlet order. With a geometry budget, meshes are also cut along a
+// uniform grid and every cell becomes its own chunk, otherwise the whole scene is one chunk. Quantized scenes store
+// 16 bit positions, half float texture coordinates and, for meshes with at most 64K vertices, 16 bit indices.
+// Load time processing selected in the options is baked into the cache, a cache built with other options is rebuilt.
+void loadScene(const std::string& sceneFileName, const Options& options, Scene& scene, TextureTable& textures);
+
@@ -0,0 +1,331 @@
+#include "texture.h"
+
+#include <cstring>
+#include <stb/stb_image.h>
+#include <stdexcept>
+
+#include "parallel.h"
+#include "trace.h"
+
+namespace {
+
+constexpr u32 TEXTURE_CACHE_MAGIC = 0x58455452; // "RTEX"
+constexpr u32 TEXTURE_CACHE_VERSION = 2;
+constexpr u32 MAX_MIP_LEVELS = 32;
+constexpr size_t TEXEL_ALIGNMENT = 16;
+
+struct TextureCacheHeader {
+	u32 magic;
+	u32 version;
+	u64 sourceHash;
+	u64 sourceSize;
+	u32 levelCount;
+	TextureFormat format;
+};
+
+struct TextureCacheLevel {
+	u64 offset;
+	u32 width;
+	u32 height;
+};
+
+size_t alignUp(size_t value, size_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+void downsample(const u8* src, u32 srcWidth, u32 srcHeight, u8* dst, u32 dstWidth, u32 dstHeight) {
+	for (u32 y = 0; y < dstHeight; ++y) {
+		auto y0 = std::min(2 * y, srcHeight - 1);
+		auto y1 = std::min(2 * y + 1, srcHeight - 1);
+		for (u32 x = 0; x < dstWidth; ++x) {
+			auto x0 = std::min(2 * x, srcWidth - 1);
+			auto x1 = std::min(2 * x + 1, srcWidth - 1);
+			for (u32 c = 0; c < 4; ++c) {
+				u32 sum = src[4 * (y0 * srcWidth + x0) + c] + src[4 * (y0 * srcWidth + x1) + c] 
+					+ src[4 * (y1 * srcWidth + x0) + c] + src[4 * (y1 * srcWidth + x1) + c];
+				dst[4 * (y * dstWidth + x) + c] = static_cast<u8>((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+std::vector<u8> buildTextureCache(const std::string& path, const MappedFile& source, u64 sourceHash, bool compressed) {
+	i32 width, height, numChannels;
+	std::unique_ptr<stbi_uc, void (*)(void*)> decoded(
+		stbi_load_from_memory(source.data(), static_cast<int>(source.size()), &width, &height, &numChannels, 4), 
+		stbi_image_free);
+
+	if (decoded == nullptr) {
+		std::cerr << "Could not decode texture file: " << path << std::endl;
+		throw std::runtime_error("texture decode failed");
+	}
+
+	std::vector<std::vector<u8>> chain;
+	std::vector<uvec2> sizes{uvec2(width, height)};
+	chain.emplace_back(decoded.get(), decoded.get() + size_t(width) * height * 4);
+	while (sizes.back() != uvec2(1, 1)) {
+		auto src = sizes.back();
+		uvec2 dst(std::max(1u, src.x / 2), std::max(1u, src.y / 2));
+		chain.emplace_back(size_t(dst.x) * dst.y * 4);
+		downsample(chain[chain.size() - 2].data(), src.x, src.y, chain.back().data(), dst.x, dst.y);
+		sizes.push_back(dst);
+	}
+
+	auto format = TextureFormat::RGBA8;
+	if (compressed) {
+		auto hasAlpha = false;
+		for (size_t i = 3; i < chain[0].size() && !hasAlpha; i += 4) {
+			hasAlpha = chain[0][i] != 255;
+		}
+		format = hasAlpha ? TextureFormat::BC3 : TextureFormat::BC1;
+	}
+
+	std::vector<TextureCacheLevel> levels;
+	size_t offset = alignUp(sizeof(TextureCacheHeader) + MAX_MIP_LEVELS * sizeof(TextureCacheLevel), TEXEL_ALIGNMENT);
+	for (const auto& size : sizes) {
+		levels.push_back({offset, size.x, size.y});
+		offset = alignUp(offset + levelBytes(format, size.x, size.y), TEXEL_ALIGNMENT);
+	}
+
+	std::vector<u8> ret(offset, 0);
+	TextureCacheHeader header{TEXTURE_CACHE_MAGIC, TEXTURE_CACHE_VERSION, sourceHash, source.size(), u32(levels.size()), format};
+	std::memcpy(ret.data(), &header, sizeof(header));
+	std::memcpy(ret.data() + sizeof(header), levels.data(), levels.size() * sizeof(TextureCacheLevel));
+	for (size_t i = 0; i < levels.size(); ++i) {
+		if (format == TextureFormat::RGBA8) {
+			std::memcpy(ret.data() + levels[i].offset, chain[i].data(), chain[i].size());
+		} else {
+			compressImage(format, chain[i].data(), levels[i].width, levels[i].height, ret.data() + levels[i].offset);
+		}
+	}
+
+	return ret;
+}
+
+// Validates the cache against its source and fills in the levels it holds, or leaves them empty if the cache is
+// stale or corrupt
+void readTextureCache(const u8* data, size_t size, u64 sourceHash, u64 sourceSize, bool compressed, Texture& texture) {
+	texture.levels.clear();
+
+	TextureCacheHeader header;
+	if (size < sizeof(header) + MAX_MIP_LEVELS * sizeof(TextureCacheLevel)) {
+		return;
+	}
+
+	std::memcpy(&header, data, sizeof(header));
+	if (header.magic != TEXTURE_CACHE_MAGIC || header.version != TEXTURE_CACHE_VERSION 
+		|| header.sourceHash != sourceHash || header.sourceSize != sourceSize
+		|| header.levelCount == 0 || header.levelCount > MAX_MIP_LEVELS
+		|| (header.format != TextureFormat::RGBA8) != compressed) {
+		return;
+	}
+
+	std::vector<MipLevel> levels;
+	for (u32 i = 0; i < header.levelCount; ++i) {
+		TextureCacheLevel level;
+		std::memcpy(&level, data + sizeof(header) + i * sizeof(level), sizeof(level));
+		if (level.width == 0 || level.height == 0 
+			|| level.offset + levelBytes(header.format, level.width, level.height) > size) {
+			return;
+		}
+		levels.push_back({data + level.offset, level.width, level.height});
+	}
+
+	texture.format = header.format;
+	texture.levels = std::move(levels);
+}
+
+}
+
+size_t textureMemory(const Texture& texture) {
+	// a texture whose cache could not be written holds its whole chain in memory
+	if (!texture.ownedTexels.empty()) {
+		return texture.ownedTexels.size();
+	}
+	// the smaller levels are never read, so their pages of the mapped cache file are never faulted in
+	const auto& level = texture.levels[0];
+	return levelBytes(texture.format, level.width, level.height);
+}
+
+float frac(float x) {
+	float tmp = x - static_cast<i64>(x);
+	return tmp >= 0.0f ? tmp : 1.0f + tmp;
+}
+
+std::unique_ptr<Texture> loadTexture(const std::string& path, bool compressed) {
+	MappedFile source(path);
+	auto sourceHash = contentHash(source.data(), source.size());
+	auto cachePath = path + (compressed ? ".bc.rtex" : ".rtex");
+	auto ret = std::make_unique<Texture>();
+
+	ret->mapping = MappedFile::openIfExists(cachePath);
+	if (ret->mapping.isOpen()) {
+		readTextureCache(ret->mapping.data(), ret->mapping.size(), sourceHash, source.size(), compressed, *ret);
+		if (!ret->levels.empty()) {
+			return ret;
+		}
+		ret->mapping = MappedFile();
+	}
+
+	auto cache = buildTextureCache(path, source, sourceHash, compressed);
+	try {
+		writeFileAtomically(cachePath, cache);
+		std::cout << "Rebuilt texture cache " << cachePath << std::endl;
+		ret->mapping = MappedFile(cachePath);
+		readTextureCache(ret->mapping.data(), ret->mapping.size(), sourceHash, source.size(), compressed, *ret);
+	} catch (const std::runtime_error&) {
+		std::cerr << "Texture cache unavailable, keeping " << path << " in memory" << std::endl;
+		ret->mapping = MappedFile();
+		ret->ownedTexels = std::move(cache);
+		readTextureCache(ret->ownedTexels.data(), ret->ownedTexels.size(), sourceHash, source.size(), compressed, *ret);
+	}
+
+	if (ret->levels.empty()) {
+		std::cerr << "Texture cache is corrupt: " << cachePath << std::endl;
+		throw std::runtime_error("texture cache corrupt");
+	}
+
+	return ret;
+}
+
+TextureTable::TextureTable() {
+	static const u8 PLACEHOLDER_TEXEL[4] = {128, 128, 128, 255};
+	m_placeholder.levels.push_back({PLACEHOLDER_TEXEL, 1, 1});
+}
+
+TextureTable::~TextureTable() {
+	// queued loads return right away, the running ones are waited for since they publish into this object
+	m_cancelLoads = true;
+	std::vector<Job> loads;
+	{
+		std::lock_guard<std::mutex> guard(m_loadLock);
+		loads.swap(m_loads);
+	}
+	for (const auto& load : loads) {
+		waitForJob(load);
+	}
+}
+
+TextureHandle TextureTable::add(const std::string& path) {
+	m_slots.emplace_back();
+	m_slots.back().path = path;
+	return TextureHandle(m_slots.size() - 1);
+}
+
+void TextureTable::setLazy(bool lazy, size_t budgetBytes) {
+	if (!lazy && budgetBytes > 0) {
+		std::cerr << "The texture budget only applies to lazily loaded textures, ignoring it" << std::endl;
+		budgetBytes = 0;
+	}
+	m_lazy = lazy;
+	m_budgetBytes = budgetBytes;
+}
+
+void TextureTable::loadAll() {
+	std::vector<TextureHandle> toLoad;
+	for (TextureHandle handle = 0; handle < m_slots.size(); ++handle) {
+		if (!m_slots[handle].texture) {
+			toLoad.push_back(handle);
+		}
+	}
+
+	std::vector<std::chrono::microseconds> loadTimes(toLoad.size());
+	auto loadStart = std::chrono::steady_clock::now();
+	parallelFor(toLoad.size(), [&](size_t i) {
+		auto textureStart = std::chrono::steady_clock::now();
+		m_slots[toLoad[i]].texture = loadTexture(m_slots[toLoad[i]].path, m_compressed);
+		loadTimes[i] = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - textureStart);
+	});
+	auto loadTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - loadStart);
+
+	std::chrono::microseconds loadTimeSum{0};
+	for (size_t i = 0; i < toLoad.size(); ++i) {
+		std::cout << "Loaded " << m_slots[toLoad[i]].path << " in " << loadTimes[i].count() / 1000 << "ms" << std::endl;
+		loadTimeSum += loadTimes[i];
+		m_residentBytes += textureMemory(*m_slots[toLoad[i]].texture);
+	}
+	std::cout << "Loaded " << toLoad.size() << " textures in " << loadTime.count() << "ms"
+		<< " (" << loadTimeSum.count() / 1000 << "ms summed over textures)" << std::endl;
+}
+
+const Texture& TextureTable::acquire(TextureHandle handle) {
+	auto& slot = m_slots[handle];
+	slot.lastUsedFrame.store(m_frame, std::memory_order_relaxed);
+	if (slot.texture) {
+		return *slot.texture;
+	}
+
+	if (m_lazy && !slot.requested.exchange(true)) {
+		std::lock_guard<std::mutex> guard(m_loadLock);
+		m_loads.push_back(submitJob([this, handle]() { loadLazily(handle); }));
+	}
+
+	return m_placeholder;
+}
+
+void TextureTable::endFrame() {
+	std::vector<std::pair<TextureHandle, std::unique_ptr<Texture>>> completed;
+	{
+		std::lock_guard<std::mutex> guard(m_loadLock);
+		completed.swap(m_completed);
+		m_loads.erase(std::remove_if(m_loads.begin(), m_loads.end(), jobDone), m_loads.end());
+	}
+
+	for (auto& loaded : completed) {
+		auto& slot = m_slots[loaded.first];
+		if (loaded.second) {
+			m_residentBytes += textureMemory(*loaded.second);
+			slot.texture = std::move(loaded.second);
+		}
+	}
+
+	// eagerly loaded textures are never reloaded, so they are never evicted either
+	if (m_lazy) {
+		evictOverBudget();
+	}
+	++m_frame;
+}
+
+void TextureTable::evictOverBudget() {
+	if (m_budgetBytes == 0 || m_residentBytes <= m_budgetBytes) {
+		return;
+	}
+
+	std::vector<TextureHandle> candidates;
+	for (TextureHandle handle = 0; handle < m_slots.size(); ++handle) {
+		const auto& slot = m_slots[handle];
+		if (slot.texture && slot.lastUsedFrame.load(std::memory_order_relaxed) < m_frame) {
+			candidates.push_back(handle);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](TextureHandle a, TextureHandle b) {
+		return m_slots[a].lastUsedFrame.load(std::memory_order_relaxed) < m_slots[b].lastUsedFrame.load(std::memory_order_relaxed);
+	});
+
+	for (auto handle : candidates) {
+		if (m_residentBytes <= m_budgetBytes) {
+			break;
+		}
+		auto& slot = m_slots[handle];
+		m_residentBytes -= textureMemory(*slot.texture);
+		slot.texture.reset();
+		slot.requested = false;
+	}
+}
+
+void TextureTable::loadLazily(TextureHandle handle) {
+	if (m_cancelLoads) {
+		return;
+	}
+
+	std::unique_ptr<Texture> loaded;
+	try {
+		TraceScope trace("load texture", handle);
+		loaded = loadTexture(m_slots[handle].path, m_compressed);
+	} catch (const std::runtime_error&) {
+		std::cerr << "Texture " << m_slots[handle].path << " stays a placeholder" << std::endl;
+	}
+
+	std::lock_guard<std::mutex> guard(m_loadLock);
+	m_completed.emplace_back(handle, std::move(loaded));
+}
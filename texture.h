@@ -0,0 +1,151 @@
+#pragma once
+
+#include "predef.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "block_compression.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "rasterizer.h"
+#include "TypeUtil.h"
+
+using TextureHandle = u32;
+
+// One level of a mip chain, stored as tightly packed rows of RGBA8 texels or of 4x4 blocks
+struct MipLevel {
+	const u8* texels;
+	u32 width;
+	u32 height;
+};
+
+// Level 0 is full resolution, each following level halves both dimensions down to 1x1. Only level 0 is sampled so
+// far, the smaller levels are kept in the cache for filtered sampling later on.
+// The texels live either in the memory mapped cache file or, if the cache could not be written, in owned memory.
+struct Texture {
+	TextureFormat format = TextureFormat::RGBA8;
+	std::vector<MipLevel> levels;
+	MappedFile mapping;
+	std::vector<u8> ownedTexels;
+};
+
+// Bytes the texture keeps resident: level 0 of a mapped cache, which is all the sampler reads, or the owned texels
+size_t textureMemory(const Texture& texture);
+
+// Loads an image through its binary cache file ("<path>.rtex"), which holds the decoded RGBA8 mip chain and a
+// hash of the source file. The cache is rebuilt whenever it is missing or the source file changed.
+// Compressed textures are cached separately ("<path>.bc.rtex") as BC1, or as BC3 if the image has any transparency.
+std::unique_ptr<Texture> loadTexture(const std::string& path, bool compressed = false);
+
+// Owns every texture of the scene, addressed by dense handles.
+// Textures are either all loaded up front (loadAll), or made resident lazily: the first sample of a non-resident
+// texture queues a job loading it and the sampler reads a placeholder until the load is published by
+// endFrame. Residency is per texture and charged with textureMemory, no mip levels are selected or paged separately.
+// In lazy mode endFrame is also where textures unused in the current frame are evicted, least recently
+// used first, while the resident set exceeds the memory budget. Since it only runs between frames, residency never
+// changes under a shader that is sampling.
+class TextureTable {
+public:
+	TextureTable();
+	~TextureTable();
+	TextureTable(const TextureTable&) = delete;
+	TextureTable& operator=(const TextureTable&) = delete;
+
+	// Registers a texture file without loading it
+	TextureHandle add(const std::string& path);
+	size_t size() const { return m_slots.size(); }
+
+	// budgetBytes of 0 means unlimited. The budget is ignored unless lazy, as evicted textures are only reloaded then.
+	void setLazy(bool lazy, size_t budgetBytes);
+	bool isLazy() const { return m_lazy; }
+
+	// Keep textures loaded from now on block compressed
+	void setCompressed(bool compressed) { m_compressed = compressed; }
+
+	// Loads every registered texture that is not resident yet, in parallel
+	void loadAll();
+
+	// Returns the texture if it is resident, otherwise the placeholder
+	const Texture& acquire(TextureHandle handle);
+
+	void endFrame();
+
+	size_t residentBytes() const { return m_residentBytes; }
+
+private:
+	struct Slot {
+		std::string path;
+		std::unique_ptr<Texture> texture;
+		std::atomic<bool> requested{false};
+		std::atomic<u32> lastUsedFrame{0};
+	};
+
+	void loadLazily(TextureHandle handle);
+	void evictOverBudget();
+
+	std::deque<Slot> m_slots;
+	Texture m_placeholder;
+	bool m_lazy = false;
+	bool m_compressed = false;
+	size_t m_budgetBytes = 0;
+	size_t m_residentBytes = 0;
+	u32 m_frame = 1;
+
+	std::mutex m_loadLock;
+	// lazy loads not collected by endFrame yet
+	std::vector<Job> m_loads;
+	std::vector<std::pair<TextureHandle, std::unique_ptr<Texture>>> m_completed;
+	std::atomic<bool> m_cancelLoads{false};
+};
+
+float frac(float x);
+
+struct Texture2DSamplerShader : MiniFragmentShader<vec2, Texture2DSamplerShader> {
+	Texture2DSamplerShader(const Texture& tex) : texture(&tex) {
+	}
+
+	// The texture is looked up on the first sample, so draws whose fragments are all rejected never request it
+	Texture2DSamplerShader(TextureTable& table, TextureHandle handle) : table(&table), handle(handle) {
+	}
+
+	// Point samples level 0, the nearest texel without mip selection
+	vec4 shade(vec2 data) {
+		if (!texture) {
+			texture = &table->acquire(handle);
+		}
+
+		const auto& level = texture->levels[0];
+		auto s = static_cast<u32>(glm::clamp(frac(data.s) * level.width - 0.5f, 0.0f, level.width - 1.0f));
+		auto t = static_cast<u32>(glm::clamp(frac(data.t) * level.height - 0.5f, 0.0f, level.height - 1.0f));
+		auto texel = texture->format == TextureFormat::RGBA8 
+			? level.texels + 4 * (t * level.width + s) 
+			: decodedTexel(level, s, t);
+		return vec4(texel[0], texel[1], texel[2], 255.0f) * (1.0f / 255);
+	}
+
+	// Neighbouring fragments mostly sample the same 4x4 block, so the last decoded block is kept around
+	const u8* decodedTexel(const MipLevel& level, u32 s, u32 t) {
+		auto block = level.texels 
+			+ (size_t(t / BLOCK_DIM) * blocksAcross(level.width) + s / BLOCK_DIM) * blockBytes(texture->format);
+		if (block != cachedBlock) {
+			if (texture->format == TextureFormat::BC1) {
+				decodeBC1(block, decodedBlock);
+			} else {
+				decodeBC3(block, decodedBlock);
+			}
+			cachedBlock = block;
+		}
+		return decodedBlock + 4 * ((t % BLOCK_DIM) * BLOCK_DIM + s % BLOCK_DIM);
+	}
+
+	const Texture* texture = nullptr;
+	TextureTable* table = nullptr;
+	TextureHandle handle = 0;
+	const u8* cachedBlock = nullptr;
+	u8 decodedBlock[BLOCK_DIM * BLOCK_DIM * 4];
+};
+
@@ -0,0 +1,130 @@
+#include "trace.h"
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+// Events kept per thread, a power of two
+constexpr size_t TRACE_RING_SIZE = 1 << 16;
+
+struct TraceEvent {
+	const char* name;
+	u64 begin;
+	u64 end;
+	i64 id;
+};
+
+// Ring buffer only its thread writes to. Publishing the head with release ordering lets the exporter read every
+// event before the head without a lock.
+struct TraceRing {
+	u32 tid;
+	std::string threadName;
+	std::atomic<u64> head{0};
+	std::vector<TraceEvent> events = std::vector<TraceEvent>(TRACE_RING_SIZE);
+};
+
+const auto g_traceEpoch = std::chrono::steady_clock::now();
+
+std::mutex g_ringsLock;
+// rings outlive their threads, so the events of finished workers are still exported
+std::vector<std::unique_ptr<TraceRing>> g_rings;
+
+TraceRing& threadRing() {
+	thread_local TraceRing* ring = nullptr;
+	if (!ring) {
+		std::lock_guard<std::mutex> lock(g_ringsLock);
+		g_rings.push_back(std::make_unique<TraceRing>());
+		ring = g_rings.back().get();
+		ring->tid = u32(g_rings.size());
+		ring->threadName = "thread " + std::to_string(ring->tid);
+	}
+	return *ring;
+}
+
+// Chrome trace timestamps are in microseconds
+double toTraceTime(u64 nanoseconds) {
+	return nanoseconds / 1000.0;
+}
+
+}
+
+namespace detail {
+
+std::atomic<bool> g_tracingEnabled{false};
+
+u64 traceNow() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_traceEpoch).count();
+}
+
+void recordTraceEvent(const char* name, u64 begin, u64 end, i64 id) {
+	auto& ring = threadRing();
+	auto head = ring.head.load(std::memory_order_relaxed);
+	ring.events[head % TRACE_RING_SIZE] = {name, begin, end, id};
+	ring.head.store(head + 1, std::memory_order_release);
+}
+
+}
+
+void enableTracing(bool enabled) {
+	if constexpr (!TRACING) {
+		if (enabled) {
+			std::cerr << "Tracing is not compiled in, configure with RASTER_TRACING" << std::endl;
+		}
+		return;
+	}
+	detail::g_tracingEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void setTraceThreadName(const std::string& name) {
+	if constexpr (TRACING) {
+		auto& ring = threadRing();
+		std::lock_guard<std::mutex> lock(g_ringsLock);
+		ring.threadName = name;
+	}
+}
+
+void writeChromeTrace(const std::string& path) {
+	std::ofstream out(path);
+	if (!out) {
+		std::cerr << "Could not open " << path << " for writing" << std::endl;
+		throw std::runtime_error("trace not written");
+	}
+
+	std::lock_guard<std::mutex> lock(g_ringsLock);
+	out << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	auto first = true;
+	auto separator = [&]() -> const char* {
+		auto ret = first ? "\n" : ",\n";
+		first = false;
+		return ret;
+	};
+
+	size_t eventCount = 0;
+	for (const auto& ring : g_rings) {
+		out << separator() << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << ring->tid
+			<< ", \"args\": {\"name\": \"" << ring->threadName << "\"}}";
+
+		auto head = ring->head.load(std::memory_order_acquire);
+		auto begin = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+		for (auto i = begin; i < head; ++i) {
+			const auto& event = ring->events[i % TRACE_RING_SIZE];
+			out << separator() << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << ring->tid
+				<< ", \"ts\": " << toTraceTime(event.begin) << ", \"dur\": " << toTraceTime(event.end - event.begin);
+			if (event.id >= 0) {
+				out << ", \"args\": {\"id\": " << event.id << "}";
+			}
+			out << "}";
+		}
+		eventCount += head - begin;
+	}
+	out << "\n]}" << std::endl;
+
+	if (!out) {
+		std::cerr << "Could not write " << path << std::endl;
+		throw std::runtime_error("trace not written");
+	}
+	std::cout << "Wrote " << eventCount << " trace events to " << path << std::endl;
+}
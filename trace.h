@@ -0,0 +1,71 @@
+#pragma once
+
+#include "predef.h"
+
+#include <atomic>
+#include <string>
+
+#include "TypeUtil.h"
+
+// Timeline tracing is only compiled into builds with RASTER_TRACING defined. Without it trace scopes are empty and
+// cost nothing, with it they cost one relaxed load while tracing is not enabled at runtime.
+#ifdef RASTER_TRACING
+constexpr bool TRACING = true;
+#else
+constexpr bool TRACING = false;
+#endif
+
+namespace detail {
+
+extern std::atomic<bool> g_tracingEnabled;
+
+u64 traceNow();
+void recordTraceEvent(const char* name, u64 begin, u64 end, i64 id);
+
+}
+
+// Starts or stops recording. Events are kept in a ring buffer per thread, so only the most recent ones of every
+// thread survive a long run.
+void enableTracing(bool enabled);
+
+inline bool tracingEnabled() {
+	return TRACING && detail::g_tracingEnabled.load(std::memory_order_relaxed);
+}
+
+// Name shown for the calling thread's events
+void setTraceThreadName(const std::string& name);
+
+// Writes the recorded events as Chrome trace JSON, which Perfetto and chrome://tracing open. Threads must not
+// record while the trace is written.
+void writeChromeTrace(const std::string& path);
+
+// Records the time from construction to destruction as one event. The name must outlive the trace, it is stored
+// as a pointer. An id, such as the index of the drawn mesh, is shown with the event when not negative.
+class TraceScope {
+public:
+	explicit TraceScope(const char* name, i64 id = -1) {
+		if constexpr (TRACING) {
+			if (tracingEnabled()) {
+				m_name = name;
+				m_id = id;
+				m_begin = detail::traceNow();
+			}
+		}
+	}
+
+	~TraceScope() {
+		if constexpr (TRACING) {
+			if (m_name) {
+				detail::recordTraceEvent(m_name, m_begin, detail::traceNow(), m_id);
+			}
+		}
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* m_name = nullptr;
+	i64 m_id = -1;
+	u64 m_begin = 0;
+};
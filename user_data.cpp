@@ -1,221 +1,405 @@
 #include "user_data.h"
 
-#include <map>
 #include <memory>
 #include <ostream>
-#include <stb/stb_image.h>
 #include <stdexcept>
-#include <tinyobjloader/tiny_obj_loader.h>
+#include <glm/gtc/packing.hpp>
 
 #include "converters.h"
+#include "geometry_pager.h"
+#include "parallel.h"
 #include "rasterizer.h"
-#include "util.h"
+#include "scene.h"
+#include "texture.h"
+#include "trace.h"
 
 using glm::perspective;
 using glm::radians;
 
-float frac(float x) {
-	float tmp = x - static_cast<i64>(x);
-	return tmp >= 0.0f ? tmp : 1.0f - tmp;
-}
-
-struct Mesh {
-	uint32_t baseIndex;
-	uint32_t indexCount;
-	std::string texName;
-};
-
-struct SortedVertex {
-	i32 positionIdx;
-	i32 texCoordIdx;
-
-	bool operator<(const SortedVertex& other) const {
-		if (positionIdx < other.positionIdx) {
-			return true;
-		}
-
-		return texCoordIdx < other.texCoordIdx; 
-	}
-};
-
-struct Texture {
-	std::unique_ptr<stbi_uc> buffer;
-	i32 width;
-	i32 height;
-	i32 numChannels;
-};
-
 struct FixedColorShader : MiniFragmentShader<vec3, FixedColorShader> {
 	vec4 shade(vec3 data) {
 		return {data, 1.0f};
 	}
 };
 
-struct Texture2DSamplerShader : MiniFragmentShader<vec2, Texture2DSamplerShader> {
-	Texture2DSamplerShader(Texture& tex) : texture(tex) {
-	}
+Scene g_scene;
+TextureTable g_textures;
+GeometryPager g_geometry;
+bool g_clusterCulling;
+float g_lodErrorPixels;
+std::vector<vec4> g_transformedVertecies;
+std::vector<vec2> g_decodedTexCoords;
+std::vector<u32> g_transformStamps;
+u32 g_currentStamp = 0;
+// vertices referenced for the first time during the current draw
+std::vector<u32> g_newVertecies;
+
+// A mesh that passed culling this frame, with its selected level of detail and the view space depth of the
+// nearest point of its bounds
+struct DrawCall {
+	const Mesh* mesh;
+	u32 lod;
+	float depth;
+};
 
-	vec4 shade(vec2 data) {
-		u16 s = frac(data.s) * texture.width - 0.5f;
-		u16 t = frac(data.t) * texture.height - 0.5f;
-		u32 idx = (t * texture.width + s) * texture.numChannels;
-		auto bufferAtIdx = texture.buffer.get() + idx;
-		return vec4(bufferAtIdx[0], bufferAtIdx[1], bufferAtIdx[2], 255.0f) * (1.0f / 255);
-	}
+DrawOrder g_drawOrder;
+std::vector<DrawCall> g_drawCalls;
+
+// One mesh's draw in a prepared frame, a range of the frame's set up triangles
+struct PreparedDraw {
+	u32 mesh;
+	TextureHandle texture;
+	size_t firstTriangle;
+	size_t triangleCount;
+};
 
-	Texture& texture;
+// A frame culled, transformed and set up by prepareFrame, waiting for rasterFrame
+struct PreparedFrame {
+	std::vector<SetupTriangle<Texture2DSamplerShader>> triangles;
+	std::vector<PreparedDraw> draws;
+	FrameStats stats;
+	std::vector<PipelineStats> meshPipelineStats;
 };
 
-std::vector<vec3> g_vertecies;
-std::vector<vec2> g_texCoords;
-std::vector<std::array<u32, 3>> g_indices;
-std::vector<Mesh> g_meshes;
-std::map<std::string, std::unique_ptr<Texture>> g_textures;
+PreparedFrame g_preparedFrames[2];
+
+FrameStats g_frameStats;
+std::vector<PipelineStats> g_meshPipelineStats;
 
 mat4 g_view;
 mat4 g_proj;
-vec3 g_cameraPos(0, -8.5, -5);
-vec3 g_cameraTarget(20, 5, 1);
+Camera g_camera = {vec3(-2.5f, -8.5f, -4.330127f), vec3(17.820508f, 5, -9.133975f)};
 vec3 g_cameraUp(0, 1, 0);	
 
-std::map<std::string, std::unique_ptr<Texture>> loadMaterials(const std::vector<tinyobj::material_t>& materials) {
-	std::map<std::string, std::unique_ptr<Texture>> ret;
-	for (const auto& mat : materials) {
-		auto name = mat.diffuse_texname;
-		if (name.empty()) {
-			std::cerr << "Missing texture file" << std::endl;
-			throw std::runtime_error("no tex file");
-		}
+void init(const uvec2& viewport, const Options& options) {
+	float nearPlane = 0.125f;
+	float farPlane = 5000.f;
+	
+	g_proj = glm::perspective(
+		glm::radians(60.f), 
+		static_cast<float>(viewport.x) / static_cast<float>(viewport.y), 
+		nearPlane, 
+		farPlane);
 
-		if (ret.find(name) == ret.end()) {
-			auto actualMaterialPath = "../resources/" + name;
-			auto newTex = std::make_unique<Texture>();
-			newTex->buffer = std::unique_ptr<stbi_uc>(stbi_load(actualMaterialPath.c_str(), 
-				&newTex->width, &newTex->height, &newTex->numChannels, 0));
+	g_clusterCulling = options.clusterCulling;
+	g_lodErrorPixels = options.lodErrorPixels;
+	g_drawOrder = options.drawOrder;
+	g_textures.setLazy(options.lazyTextures, options.textureBudget);
+	g_textures.setCompressed(options.compressedTextures);
+	loadScene(options.scenePath, options, g_scene, g_textures);
+	g_geometry.attach(g_scene, options.geometryBudget);
+}
 
-			if (newTex->buffer == nullptr) {
-				std::cerr << "Could not load material file: " << actualMaterialPath << std::endl;
-				throw std::runtime_error("material file load failed");
+// Collects the vertices the triangles reference that were not referenced yet during the current draw into
+// g_newVertecies
+template <typename Index>
+void collectNewVertecies(Span<const std::array<Index, 3>> indices) {
+	g_newVertecies.clear();
+	for (const auto& tri : indices) {
+		for (u32 v : tri) {
+			if (g_transformStamps[v] != g_currentStamp) {
+				g_transformStamps[v] = g_currentStamp;
+				g_newVertecies.push_back(v);
 			}
+		}
+	}
+}
 
-			ret[name] = std::move(newTex);
+// Calls process for every vertex in g_newVertecies, in parallel chunks, each of which adds its statistics to the
+// thread it ran on
+template <typename Process>
+void forEachNewVertex(Process process) {
+	parallelFor(detail::chunkCount(g_newVertecies.size(), detail::TRANSFORM_CHUNK), [&](size_t chunk) {
+		PipelineStats stats;
+		auto ticks = pipelineTicks();
+		auto first = chunk * detail::TRANSFORM_CHUNK;
+		auto end = std::min(g_newVertecies.size(), first + detail::TRANSFORM_CHUNK);
+		for (auto i = first; i < end; ++i) {
+			process(g_newVertecies[i]);
 		}
+		stats.time(PipelineStage::Transform, ticks);
+		stats.count(PipelineCounter::VerticesTransformed, end - first);
+		addThreadPipelineStats(stats);
+	});
+}
+
+// Transforms the vertices the triangles reference that were not transformed yet during the current draw, decoding
+// the texture coordinates of quantized meshes along the way. For quantized meshes mvp includes the decode transform.
+template <typename Index>
+void transformReferenced(Span<const std::array<Index, 3>> indices, const Mesh& mesh, const mat4& mvp) {
+	collectNewVertecies(indices);
+	if (g_scene.quantized) {
+		auto vertecies = g_scene.quantizedVertecies.subspan(mesh.baseVertex, mesh.vertexCount);
+		auto texCoords = g_scene.halfTexCoords.subspan(mesh.baseVertex, mesh.vertexCount);
+		forEachNewVertex([&](u32 v) {
+			g_transformedVertecies[v] = mvp * vec4(vertecies[v][0], vertecies[v][1], vertecies[v][2], 1.0f);
+			g_decodedTexCoords[v] = glm::unpackHalf2x16(texCoords[v]);
+		});
+	} else {
+		auto vertecies = g_scene.vertecies.subspan(mesh.baseVertex, mesh.vertexCount);
+		forEachNewVertex([&](u32 v) {
+			g_transformedVertecies[v] = mvp * vec4(vertecies[v], 1.0f);
+		});
+	}
+}
+
+// The coarsest level of detail whose RMS error estimate projects to at most g_lodErrorPixels, 0 being the full mesh
+u32 selectLod(const Mesh& mesh, const vec3& cameraPos, float pixelsPerUnit) {
+	auto distance = glm::length(mesh.center - cameraPos) - mesh.radius;
+	if (g_lodErrorPixels <= 0.0f || distance <= 0.0f) {
+		return 0;
 	}
 
+	u32 ret = 0;
+	for (u32 level = 0; level < mesh.lodCount; ++level) {
+		if (g_scene.lods[mesh.baseLod + level].error * pixelsPerUnit / distance <= g_lodErrorPixels) {
+			ret = level + 1;
+		}
+	}
 	return ret;
 }
 
-void loadScene(
-	const std::string& sceneFileName, 
-	std::vector<vec3>& vertecies, std::vector<vec2>& texCoords, 
-	std::vector<std::array<u32, 3>>& indices, 
-	std::vector<Mesh>& meshes,
-	std::map<std::string, std::unique_ptr<Texture>>& textures) {
-	tinyobj::attrib_t attribs;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string warn;
-	std::string err;
-
-	auto actualFilePath = "../resources/" + sceneFileName;
-	auto status = tinyobj::LoadObj(
-		&attribs, &shapes, &materials, 
-		&warn, &err, 
-		actualFilePath.c_str(), "../resources",
-		true, true);
-
-	if (!warn.empty()) {
-		std::cerr << "TinyObj loaded with warnings:" << std::endl;
-		std::cerr << warn << std::endl;
+// Front to back order of the mesh's meshlets precomputed for the direction closest to the view direction, see
+// Scene::meshletOrders. A mesh around the camera is viewed along the camera's forward direction.
+Span<const u32> meshletOrder(const Mesh& mesh, const vec3& cameraPos, const vec3& cameraForward) {
+	auto toMesh = mesh.center - cameraPos;
+	auto inside = glm::length(toMesh) <= mesh.radius;
+	auto direction = closestMeshletOrderDirection(inside ? cameraForward : toMesh);
+	return g_scene.meshletOrders.subspan(
+		size_t(mesh.baseMeshlet) * MESHLET_ORDER_DIRECTIONS + size_t(direction) * mesh.meshletCount, mesh.meshletCount);
+}
+
+// Sets up the full mesh as the meshlets that survive culling, or a coarser level of detail as a whole, appending
+// the triangles to the frame. Only the vertices referenced by what is drawn are transformed. With front to back
+// drawing, meshlets are visited in their precomputed order for the view direction.
+template <typename Index>
+void prepareMesh(
+	const Mesh& mesh, Span<const std::array<Index, 3>> indexStream, u32 lod, 
+	const uvec2& viewport, const mat4& mvp, 
+	const Frustum& frustum, const vec3& cameraPos, const vec3& cameraForward,
+	PreparedFrame& frame) {
+	TraceScope trace("draw", &mesh - g_scene.meshes.data());
+	g_transformedVertecies.resize(mesh.vertexCount);
+	// stamps only grow, so entries left over from earlier draws never match the current one
+	g_transformStamps.resize(mesh.vertexCount, 0);
+	++g_currentStamp;
+
+	auto meshMvp = mvp;
+	auto texCoords = Span<const vec2>();
+	if (g_scene.quantized) {
+		meshMvp = glm::scale(glm::translate(mvp, mesh.decodeOffset), mesh.decodeScale);
+		g_decodedTexCoords.resize(mesh.vertexCount);
+		texCoords = g_decodedTexCoords;
+	} else {
+		texCoords = g_scene.texCoords.subspan(mesh.baseVertex, mesh.vertexCount);
+	}
+
+	if (lod > 0) {
+		const auto& level = g_scene.lods[mesh.baseLod + lod - 1];
+		auto indices = indexStream.subspan(level.baseIndex, level.indexCount);
+		{
+			TraceScope transformTrace("transform");
+			transformReferenced(indices, mesh, meshMvp);
+		}
+		TraceScope setupTrace("setup");
+		frame.stats.triangles += indices.size();
+		setupTransformedTriangles(viewport, Span<const vec4>(g_transformedVertecies), texCoords, indices, frame.triangles);
+		return;
+	}
+
+	// the triangles of the visible meshlets are gathered into one batch, so transform and setup split into chunks
+	// across the workers even though meshlets are small
+	static std::vector<std::array<Index, 3>> visibleIndices;
+	visibleIndices.clear();
+	auto indices = indexStream.subspan(mesh.baseIndex, mesh.indexCount);
+	auto meshlets = g_scene.meshlets.subspan(mesh.baseMeshlet, mesh.meshletCount);
+	auto order = g_drawOrder == DrawOrder::FrontToBack ? meshletOrder(mesh, cameraPos, cameraForward) : Span<const u32>();
+	for (u32 i = 0; i < meshlets.size(); ++i) {
+		const auto& meshlet = meshlets[order.empty() ? i : order[i]];
+		if (g_clusterCulling && (!frustum.intersects(meshlet.center, meshlet.radius) || isBackfacing(meshlet, cameraPos))) {
+			continue;
+		}
+
+		auto meshletIndices = indices.subspan(meshlet.baseIndex, meshlet.indexCount);
+		visibleIndices.insert(visibleIndices.end(), meshletIndices.begin(), meshletIndices.end());
 	}
-	if (!status) {
-		std::cerr << "TinyObj failed to load " << actualFilePath << ":" << std::endl;
-		std::cerr << err << std::endl;
-		throw std::runtime_error("TinyObj failed to load");
+
+	{
+		TraceScope transformTrace("transform");
+		transformReferenced(Span<const std::array<Index, 3>>(visibleIndices), mesh, meshMvp);
 	}
 
-	textures = loadMaterials(materials);	
+	TraceScope setupTrace("setup");
+	frame.stats.triangles += visibleIndices.size();
+	setupTransformedTriangles(
+		viewport, 
+		Span<const vec4>(g_transformedVertecies), 
+		texCoords, 
+		Span<const std::array<Index, 3>>(visibleIndices),
+		frame.triangles);
+}
 
-	std::map<SortedVertex, uint32_t> indexedVertecies;
-	indices.push_back({});
+// Number of times consecutive draws use different textures
+u32 countTextureSwitches(const std::vector<DrawCall>& drawCalls) {
+	u32 ret = 0;
+	for (size_t i = 1; i < drawCalls.size(); ++i) {
+		ret += drawCalls[i].mesh->texture != drawCalls[i - 1].mesh->texture;
+	}
+	return ret;
+}
 
-	for (const auto& shape : shapes) {
-		auto meshBaseIdx = uint32_t(indices.size());	
+void rasterDraw(
+	const uvec2& viewport, const PreparedFrame& frame, const PreparedDraw& draw, Texture2DSamplerShader& shader,
+	float* depthBuffer, Color* colorBuffer) {
+	TraceScope trace("raster", draw.mesh);
+	auto triangles = Span<const SetupTriangle<Texture2DSamplerShader>>(frame.triangles);
+	rasterSetupTriangles(
+		viewport, triangles.subspan(draw.firstTriangle, draw.triangleCount), shader, depthBuffer, colorBuffer);
+}
 
-		u32 triangleVertexIdx = 0;
-		for (const auto& index : shape.mesh.indices) {
-			if (triangleVertexIdx == 3) {
-				indices.push_back({});
-				triangleVertexIdx = 0;
-			}
+// Culls, transforms, clips and sets up the scene as seen from the camera into the frame. Given targets, every draw is
+// rasterized into them as soon as it is set up and its triangles are dropped, so only one draw's triangles are held
+// at a time. Without targets the whole frame is kept for rasterFrame.
+void buildFrame(
+	const uvec2& viewport, const Camera& camera, PreparedFrame& frame, float* depthBuffer, Color* colorBuffer) {
+	// distance from the camera, in chunk radii, within which chunks are kept resident even when out of view
+	constexpr float STREAMING_DISTANCE = 2.0f;
 
-			auto vertIdx = index.vertex_index;
-			auto texCoordIdx = index.texcoord_index;
-			if (vertIdx == -1 || texCoordIdx == -1) {
-				throw std::runtime_error("missing vertex data");
-			}
+	frame.triangles.clear();
+	frame.draws.clear();
+	frame.stats = FrameStats();
+	g_view = lookAt(camera.position, camera.target, g_cameraUp);
 
-			SortedVertex vert{vertIdx, texCoordIdx};	
-			auto foundVert = indexedVertecies.find(vert);
-
-			u32 currentIndex;
-			if (foundVert != indexedVertecies.end()) {
-				currentIndex = foundVert->second;
-			} else {
-				currentIndex = 3 * u32(indices.size()) + triangleVertexIdx;
-				indexedVertecies[vert] = currentIndex;
-				
-				vertecies.push_back(vec3(
-					attribs.vertices[3 * vertIdx + 0], 
-					attribs.vertices[3 * vertIdx + 1], 
-					attribs.vertices[3 * vertIdx + 2]));
-				texCoords.push_back(vec2(
-					attribs.texcoords[2 * texCoordIdx + 0],
-					1.0f - attribs.texcoords[2 * texCoordIdx + 1]));				
+	auto mvp = g_proj * g_view;
+	Frustum frustum(mvp);
+	auto cameraToWorld = glm::inverse(g_view);
+	auto cameraPos = vec3(cameraToWorld[3]);
+	auto cameraForward = -vec3(cameraToWorld[2]);
+	// size of one model space unit at distance one, in pixels
+	auto pixelsPerUnit = g_proj[1][1] * viewport.y * 0.5f;
+	g_drawCalls.clear();
+	if constexpr (PIPELINE_STATS) {
+		// whatever was recorded between frames is not part of this one
+		takePipelineStats();
+		frame.meshPipelineStats.assign(g_scene.meshes.size(), PipelineStats());
+	}
+	{
+		TraceScope cullTrace("cull");
+		for (u32 c = 0; c < g_scene.chunks.size(); ++c) {
+			const auto& chunk = g_scene.chunks[c];
+			auto visible = !g_clusterCulling || frustum.intersects(chunk.center, chunk.radius);
+			// chunks around the camera are streamed in before they turn into view
+			auto nearby = glm::length(chunk.center - cameraPos) < STREAMING_DISTANCE * chunk.radius;
+			if (!visible && !nearby) {
+				continue;
+			}
+			if (!g_geometry.acquire(c) || !visible) {
+				continue;
 			}
 
-			indices.back()[triangleVertexIdx++] = currentIndex;
+			for (const auto& mesh : Span<const Mesh>(g_scene.meshes).subspan(chunk.baseMesh, chunk.meshCount)) {
+				if (g_clusterCulling && !frustum.intersects(mesh.center, mesh.radius)) {
+					continue;
+				}
+				auto depth = -(g_view * vec4(mesh.center, 1.0f)).z - mesh.radius;
+				g_drawCalls.push_back({&mesh, selectLod(mesh, cameraPos, pixelsPerUnit), depth});
+			}
 		}
+	}
 
-		Mesh newMesh{meshBaseIdx, u32(shape.mesh.indices.size() / 3), materials[shape.mesh.material_ids[0]].diffuse_texname};
-		meshes.push_back(newMesh); 
+	frame.stats.sceneOrderTextureSwitches = countTextureSwitches(g_drawCalls);
+	{
+		TraceScope sortTrace("sort");
+		if (g_drawOrder == DrawOrder::Texture) {
+			// draws sharing a texture are submitted back to back, so its texels stay in cache between them
+			std::stable_sort(g_drawCalls.begin(), g_drawCalls.end(), [](const DrawCall& a, const DrawCall& b) {
+				return a.mesh->texture < b.mesh->texture;
+			});
+		} else if (g_drawOrder == DrawOrder::FrontToBack) {
+			// nearer draws fill the depth buffer first, so hidden fragments of later ones fail the depth test unshaded
+			std::stable_sort(g_drawCalls.begin(), g_drawCalls.end(), [](const DrawCall& a, const DrawCall& b) {
+				return a.depth < b.depth;
+			});
+		}
 	}
+	frame.stats.textureSwitches = countTextureSwitches(g_drawCalls);
+
+	frame.stats.drawCalls = g_drawCalls.size();
+	for (const auto& drawCall : g_drawCalls) {
+		const auto& mesh = *drawCall.mesh;
+		auto firstTriangle = frame.triangles.size();
+		if (mesh.shortIndices) {
+			prepareMesh(mesh, g_scene.shortIndices, drawCall.lod, viewport, mvp, frustum, cameraPos, cameraForward, frame);
+		} else {
+			prepareMesh(mesh, g_scene.indices, drawCall.lod, viewport, mvp, frustum, cameraPos, cameraForward, frame);
+		}
+		auto meshIndex = u32(&mesh - g_scene.meshes.data());
+		PreparedDraw draw{meshIndex, mesh.texture, firstTriangle, frame.triangles.size() - firstTriangle};
+		if (colorBuffer) {
+			auto shader = Texture2DSamplerShader(g_textures, draw.texture);
+			rasterDraw(viewport, frame, draw, shader, depthBuffer, colorBuffer);
+			frame.triangles.clear();
+		} else {
+			frame.draws.push_back(draw);
+		}
+		if constexpr (PIPELINE_STATS) {
+			auto meshStats = takePipelineStats();
+			frame.meshPipelineStats[meshIndex] += meshStats;
+			frame.stats.pipeline += meshStats;
+		}
+	}
+
+	TraceScope endFrameTrace("end frame");
+	g_geometry.endFrame();
 }
 
-void init(const uvec2& viewport) {
-	float nearPlane = 0.125f;
-	float farPlane = 5000.f;
-	
-	g_proj = glm::perspective(
-		glm::radians(60.f), 
-		static_cast<float>(viewport.x) / static_cast<float>(viewport.y), 
-		nearPlane, 
-		farPlane);
+void periodic(const uvec2& viewport, float* depthBuffer, Color* colorBuffer) {
+	buildFrame(viewport, g_camera, g_preparedFrames[0], depthBuffer, colorBuffer);
+	g_textures.endFrame();
+	finishFrame(0);
+}
+
+void prepareFrame(const uvec2& viewport, const Camera& camera, size_t slot) {
+	buildFrame(viewport, camera, g_preparedFrames[slot], nullptr, nullptr);
+}
 
-	loadScene("sponza.obj", g_vertecies, g_texCoords, g_indices, g_meshes, g_textures);
+void rasterFrame(const uvec2& viewport, size_t slot, float* depthBuffer, Color* colorBuffer) {
+	auto& frame = g_preparedFrames[slot];
+	for (size_t first = 0, last = 0; first < frame.draws.size(); first = last) {
+		auto texture = frame.draws[first].texture;
+		auto shader = Texture2DSamplerShader(g_textures, texture);
+		for (; last < frame.draws.size() && frame.draws[last].texture == texture; ++last) {
+			const auto& draw = frame.draws[last];
+			rasterDraw(viewport, frame, draw, shader, depthBuffer, colorBuffer);
+			if constexpr (PIPELINE_STATS) {
+				auto meshStats = takePipelineStats();
+				frame.meshPipelineStats[draw.mesh] += meshStats;
+				frame.stats.pipeline += meshStats;
+			}
+		}
+	}
+
+	TraceScope endFrameTrace("end frame");
+	g_textures.endFrame();
 }
 
-void periodic(GLFWwindow* window, const uvec2& viewport, float* depthBuffer, Color* colorBuffer) {
-	constexpr float ANGLE = M_PI / 15;
+void finishFrame(size_t slot) {
+	g_frameStats = g_preparedFrames[slot].stats;
+	g_meshPipelineStats = g_preparedFrames[slot].meshPipelineStats;
+}
 
-	g_view = lookAt(g_cameraPos, g_cameraTarget, g_cameraUp);
-	g_view = glm::rotate(g_view, glm::radians(-30.f), glm::vec3(0, 1, 0));
+void setCamera(const Camera& camera) {
+	g_camera = camera;
+}
 
-	auto mvp = g_proj * g_view;
-	u32 left = g_meshes.size();
-	for (const auto& mesh : g_meshes) {
-		auto begin = g_indices.begin() + mesh.baseIndex;
-		auto end = begin + mesh.indexCount;
-		auto shader = Texture2DSamplerShader(*g_textures[mesh.texName]);
-		auto i = shader.texture.height;
-		rasterTriangleIndexed<Texture2DSamplerShader>(
-			viewport, 
-			g_vertecies, 
-			g_texCoords, 
-			std::vector<std::array<u32, 3>>{begin, end},
-			mvp, 
-			shader, 
-			depthBuffer, colorBuffer);
-	}
+const Camera& camera() {
+	return g_camera;
 }
 
+const FrameStats& lastFrameStats() {
+	return g_frameStats;
+}
+
+Span<const PipelineStats> lastFrameMeshPipelineStats() {
+	return g_meshPipelineStats;
+}
@@ -2,9 +2,47 @@
 
 #include "predef.h"
 
+#include "camera_path.h"
 #include "converters.h"
+#include "options.h"
+#include "pipeline_stats.h"
+#include "TypeUtil.h"
 
-void init(const uvec2& viewport); 
+// Work submitted by the last finished frame
+struct FrameStats {
+	u32 drawCalls = 0;
+	// triangles handed to the rasterizer, before clipping and backface culling
+	u64 triangles = 0;
+	// times consecutive draws use different textures, as submitted and as they would be in scene order
+	u32 textureSwitches = 0;
+	u32 sceneOrderTextureSwitches = 0;
+	// summed over all draws, see PIPELINE_STATS
+	PipelineStats pipeline;
+};
 
+void init(const uvec2& viewport, const Options& options); 
+
+// Renders a frame from the current camera on the calling thread and makes it the one lastFrameStats reports. Every
+// draw is rasterized as soon as it is set up, so only one draw's set up triangles are held at a time.
 void periodic(const uvec2& viewport, float* depthBuffer, Color* colorBuffer); 
 
+// The phases of a frame, for pipelining frames. Two frames can be in flight, in slots 0 and 1. Calls of one phase
+// must not overlap, but rasterizing the frame in one slot may overlap preparing the frame in the other. Pipeline
+// statistics of overlapping phases mix, as they are summed over threads.
+
+// Culls, transforms, clips and sets up the scene as seen from the camera into the slot, holding on to the set up
+// triangles of every draw until the slot is rasterized
+void prepareFrame(const uvec2& viewport, const Camera& camera, size_t slot);
+// Rasterizes the frame prepared in the slot into the targets
+void rasterFrame(const uvec2& viewport, size_t slot, float* depthBuffer, Color* colorBuffer);
+// Makes the rasterized frame in the slot the one lastFrameStats reports
+void finishFrame(size_t slot);
+
+// The camera the next frames are rendered from, initially the default view of the scene
+void setCamera(const Camera& camera);
+const Camera& camera();
+
+const FrameStats& lastFrameStats();
+// Pipeline statistics of the last frame per mesh, indexed like the scene's meshes. Empty without PIPELINE_STATS.
+Span<const PipelineStats> lastFrameMeshPipelineStats();
+